@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include "mpc.h"
 
 #define true 1
@@ -41,6 +42,16 @@ void add_history(char* unused) {}
             ltype_name(expect)); \
 })
 
+// check that args->cell[index] is a list, which may also be a sequence,
+// but report it as argument 'arg' of func
+#define LASSERT_LIST_AS(func, args, index, arg) ({ \
+    LASSERT(args, args->cell[index]->type == LVAL_QEXPR || \
+            args->cell[index]->type == LVAL_SEQ, \
+            "Function '%s' passed incorrect type for argument %i. " \
+            "Got %s, Expected %s.", func, arg, ltype_name(args->cell[index]->type), \
+            ltype_name(LVAL_QEXPR)); \
+})
+
 #define LASSERT_NUM(func, args, num) ({ \
     LASSERT(args, args->count == num, \
             "Funciton '%s' passed incorrect number of arguments. " \
@@ -59,8 +70,14 @@ void add_history(char* unused) {}
 
 struct lval;
 struct lenv;
+struct lbuf;
+struct lstrbuf;
+struct lnode;
 typedef struct lval lval;
 typedef struct lenv lenv;
+typedef struct lbuf lbuf;
+typedef struct lstrbuf lstrbuf;
+typedef struct lnode lnode;
 
 // lval type
 enum {
@@ -71,30 +88,170 @@ enum {
     LVAL_FUN,
     LVAL_SEXPR,
     LVAL_QEXPR,
+    LVAL_SEQ,
 };
 
 typedef lval *(*lbuiltin)(lenv *, lval *);
 
-struct lval {
-    int type;
+// Builtin descriptor
+// Every builtin is registered from a descriptor, see lbuiltins. The
+// evaluator checks the argument count and types against it before the
+// call, the count once per call site in quickened code, so the builtin
+// itself only checks what the descriptor cannot express.
+
+#define LDESC_ARGS 3
+#define LTYPE_ANY -1
+
+enum {
+    LDESC_PURE = 1, // no side effects, only reads its arguments
+    LDESC_CURRIED = 2, // partially applied when given too few arguments
+    LDESC_KEEPS_ARGS = 4, // returns or keeps its argument list
+};
+
+typedef struct ldesc {
+    char *name;
+    lbuiltin func; // entry point, trusting its arguments to match
+    int arity; // argument count, -1 for any number
+    int flags;
+    // type of each argument or LTYPE_ANY, for any number of arguments
+    // the first applies to every one
+    int types[LDESC_ARGS];
+    int op; // LOP_ of operators quickened nodes compute inline, or 0
+} ldesc;
+
+// type d gives argument i, or LTYPE_ANY
+int ldesc_type(const ldesc *d, int i) {
+    if (d->arity < 0) return d->types[0];
+    return i < LDESC_ARGS ? d->types[i] : LTYPE_ANY;
+}
 
+// lists up to this long store their cells inside the lval
+#define LVAL_SMALL 4
+
+// strings shorter than this store their bytes inside the lval
+#define LSTR_SMALL 36
+
+// arguments kept by an error until its message is formatted
+#define LERR_ARGS 4
+
+typedef union lerr_arg {
     long num;
-    char *err;
-    char *sym;
     char *str;
+} lerr_arg;
 
-    // Funciton
-    lbuiltin builtin;
-    lenv *env;
-    lval *formals; // formal arguments
-    lval *body; // Qexpression
+struct lval {
+    int type;
+    int flags;
+
+    union {
+        long num;
+        unsigned long hash; // of strings, and of interned lists
+    };
+
+    // NUL terminated text of an Error, Symbol or String
+    // NULL for an Error whose message is not formatted yet
+    union {
+        char *err;
+        char *sym;
+        char *str;
+
+        // node of an interned list in its code arena, see lcode_build
+        struct lnode *code;
+    };
+
+    union {
+        // Funciton
+        struct {
+            lbuiltin builtin;
+            const struct ldesc *desc; // of a builtin and its partial applications
+            lval *bound; // arguments supplied by partial application
+            union {
+                lenv *env;
+                struct lval *fn; // lambda a partial application calls
+            };
+            lval *formals; // formal arguments
+            lval *body; // Qexpression
+        };
+
+        // cells of lists short enough not to need a buffer
+        struct lval *small[LVAL_SMALL];
+
+        // String
+        // text points at chars, or into shared if the string is long
+        struct {
+            lstrbuf *shared;
+            int len;
+            char chars[LSTR_SMALL];
+        };
+
+        // Error before formatting, the format also identifies the error
+        struct {
+            char *fmt;
+            lerr_arg args[LERR_ARGS];
+        };
+
+        // Sequence, see lcursor
+        struct {
+            int seq; // LSEQ_ kind
+            long from; // first number of a range, items skipped by a drop
+            long to; // end of a range, not included
+            lval *gen; // function of an iterate, lazy-map or lazy-filter
+            // sequence or Q-expression the elements come from, or the
+            // first element of an iterate
+            lval *src;
+        };
+    };
 
     // count and array of *lval
+    // cell points into buf, which may be shared with copies of the list,
+    // or at small when buf is NULL
     int count;
-    struct lval **cell;
+
+    // owners besides the first, see lval_retain
+    int refs;
+
+    union {
+        struct {
+            struct lval **cell;
+            lbuf *buf;
+        };
+
+        // Symbol: environment its binding was last found in, counted
+        // outwards or LSLOT_GLOBAL, and its slot there, see lenv_get_slot
+        struct {
+            int depth;
+            int slot;
+        };
+    };
+};
+
+#define LSLOT_NONE -2
+#define LSLOT_GLOBAL -1
+
+// Cell storage for lists
+// Copies of large Q-expressions share one buffer and each sees its own
+// slice of it. The buffer owns the items between start and end, and is
+// copied before a shared list is modified in place.
+struct lbuf {
+    int refs;
+    int pinned; // references held by the region, see lregion_end
+    int start;
+    int end;
+    int capacity;
+    lval *items[];
+};
+
+// Q-expressions at least this long are shared rather than copied
+#define LBUF_SHARE_MIN 32
+
+// Text of a long string, shared by copies and never modified
+struct lstrbuf {
+    int refs;
+    char chars[];
 };
 
 struct lenv {
+    int flags;
     lenv *parent;
     int count;
     char **syms;
@@ -113,80 +270,666 @@ mpc_parser_t *lispy;
 // function definitions
 void lval_print(lval *v);
 lval *lval_eval(lenv *e, lval *v);
+lval *lval_eval_ref(lenv *e, lval *v);
+lval *lval_eval_body(lenv *e, lval *v);
+lval *lval_apply(lenv *e, lval *v);
 lval *lval_call(lenv *e, lval *f, lval *a);
+lval *lval_call_builtin(lenv *e, lval *f, lval *a);
+lval *lval_copy(lval *v);
+lval *lval_retain(lval *v);
+lval *lval_share_items(lval *l);
+void lval_drop_buf(lval *v);
 lenv *lenv_new();
 lenv *lenv_copy(lenv *e);
 void lenv_del(lenv *e);
 lval *lenv_get(lenv *e, lval *k);
+lval *lenv_get_borrowed(lenv *e, char *sym);
+int lenv_binds(lenv *e, char *sym);
+lval *lenv_get_slot(lenv *e, lval *k);
+lval *lenv_get_cached(lenv *e, char *sym, int *depth, int *slot);
 void lenv_put(lenv *e, lval *k, lval *v);
-void lenv_def(lenv *e, lval *k, lval *v);
+void lenv_put_move(lenv *e, lval *k, lval *v);
+
+// Object pools
+// lval and lenv objects are carved out of slabs of LPOOL_SLAB objects
+// and recycled through a free list per pool instead of going back to
+// malloc. Set JLISP_NO_POOL to use malloc directly, e.g. for sanitizers.
+
+#define LPOOL_SLAB 256
+
+typedef struct lpool {
+    size_t size;
+    void *free; // freed objects, linked through their first word
+    void *slabs; // every slab, linked through their first word
+    char *next; // unused space in the newest slab
+    char *end;
+} lpool;
+
+// allocation counters
+typedef struct lstat {
+    long live;
+    long peak;
+    long total;
+} lstat;
+
+static __thread lpool lval_pool = { sizeof(lval) };
+static __thread lpool lenv_pool = { sizeof(lenv) };
+
+static __thread lstat lval_stats[LVAL_SEQ + 1];
+static __thread lstat lenv_stats;
+
+// quickening counters, see lval_eval_quick
+typedef struct lqstat {
+    long rewritten;
+    long hits; // evaluations taking the quickened path
+    long fallbacks; // guard failures
+} lqstat;
+
+static __thread lqstat lquick_sym;
+static __thread lqstat lquick_call;
+static __thread lqstat lquick_op;
+static __thread lqstat lquick_inline;
+static __thread lqstat lquick_fuse;
+
+void *lpool_alloc(lpool *p) {
+#ifdef JLISP_NO_POOL
+    return malloc(p->size);
+#else
+    if (p->free) {
+        void *x = p->free;
+        p->free = *(void **)x;
+        return x;
+    }
+
+    if (p->next == p->end) {
+        char *slab = malloc(sizeof(void *) + p->size * LPOOL_SLAB);
+        if (!slab) return NULL;
+        *(void **)slab = p->slabs;
+        p->slabs = slab;
+        p->next = slab + sizeof(void *);
+        p->end = p->next + p->size * LPOOL_SLAB;
+    }
+
+    void *x = p->next;
+    p->next += p->size;
+    return x;
+#endif
+}
+
+void lpool_free(lpool *p, void *x) {
+#ifdef JLISP_NO_POOL
+    free(x);
+#else
+    *(void **)x = p->free;
+    p->free = x;
+#endif
+}
+
+void lstat_add(lstat *s) {
+    s->live++;
+    s->total++;
+    if (s->live > s->peak) s->peak = s->live;
+}
+
+// Array allocator
+// Variable sized arrays (list cells, environment slots) are rounded up
+// to a power of two and recycled through a free list per size class,
+// so growing or shrinking within a class never reaches realloc. Each
+// block starts with a header holding its class.
+
+#define LMEM_MIN_CLASS 4 // 16 bytes
+#define LMEM_MAX_CLASS 20 // 1MB, larger blocks are not kept for reuse
+
+static __thread void *lmem_free_lists[LMEM_MAX_CLASS + 1];
+static __thread lstat lmem_stats;
+
+int lmem_class(size_t size) {
+    int c = LMEM_MIN_CLASS;
+    while (((size_t)1 << c) < size) c++;
+    return c;
+}
+
+// Regions
+// While a top-level form is evaluated, lval, lenv and array allocations
+// come from a bump arena instead of the pools. Values stored in a heap
+// environment (the global one) are copied out to the heap, and whatever
+// is left when the form is done is dropped by one lregion_end rather
+// than deleted piece by piece. Objects freed during the form are still
+// recycled within the region, so long loops stay in bounded memory.
+// JLISP_NO_POOL turns regions off along with the pools.
+
+#define LREGION_CHUNK (1 << 16)
+
+// lval and lenv flags
+// LALLOC_INLINED marks lambdas inlined into some caller, see lnode_inline
+// LALLOC_SCRATCH marks argument lists on the stack, see lval_scratch
+// LALLOC_LOOP marks the scope of a loop counter, see builtin_dotimes
+enum {
+    LALLOC_REGION = 1,
+    LALLOC_IMMORTAL = 2,
+    LALLOC_INTERNED = 4,
+    LALLOC_INLINED = 8,
+    LALLOC_SCRATCH = 16,
+    LALLOC_LOOP = 32,
+};
+
+// set on the class in the header of region array blocks
+#define LMEM_REGION 64
+
+typedef struct lregion {
+    int active;
+    char *chunks; // linked through their first word, newest first
+    char *next;
+    char *end;
+
+    // objects freed during the form
+    void *lval_free;
+    void *lenv_free;
+    void *lmem_free[LMEM_MAX_CLASS + 1];
+
+    // heap buffers shared with region lists
+    lbuf **pinned;
+    int pinned_count;
+    int pinned_capacity;
+
+    // objects still live in the region, for the allocation counters
+    long lval_live[LVAL_SEQ + 1];
+    long lenv_live;
+    long lmem_live;
+} lregion;
+
+static __thread lregion region;
+
+void *lregion_alloc(size_t size) {
+    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+    if ((size_t)(region.end - region.next) < size) {
+        size_t n = size > LREGION_CHUNK ? size : LREGION_CHUNK;
+        char *chunk = malloc(sizeof(void *) + n);
+        if (!chunk) return NULL;
+        *(void **)chunk = region.chunks;
+        region.chunks = chunk;
+        region.next = chunk + sizeof(void *);
+        region.end = region.next + n;
+    }
+
+    void *x = region.next;
+    region.next += size;
+    return x;
+}
+
+// pop a recycled object from a region free list
+void *lregion_reuse(void **list) {
+    void *x = *list;
+    if (x) *list = *(void **)x;
+    return x;
+}
+
+void lregion_recycle(void **list, void *x) {
+    *(void **)x = *list;
+    *list = x;
+}
+
+void *lmem_alloc_in(size_t size, int in_region) {
+    int c = lmem_class(size + sizeof(size_t));
+    size_t *block = NULL;
+
+    if (in_region) {
+        if (c <= LMEM_MAX_CLASS) block = lregion_reuse(&region.lmem_free[c]);
+        if (!block) block = lregion_alloc((size_t)1 << c);
+        if (!block) return NULL;
+        block[0] = c | LMEM_REGION;
+        region.lmem_live++;
+        lstat_add(&lmem_stats);
+        return block + 1;
+    }
+
+#ifndef JLISP_NO_POOL
+    if (c <= LMEM_MAX_CLASS && lmem_free_lists[c]) {
+        block = lmem_free_lists[c];
+        lmem_free_lists[c] = *(void **)(block + 1);
+    }
+#endif
+    if (!block) block = malloc((size_t)1 << c);
+    if (!block) return NULL;
+
+    block[0] = c;
+    lstat_add(&lmem_stats);
+    return block + 1;
+}
+
+void *lmem_alloc(size_t size) {
+    return lmem_alloc_in(size, region.active);
+}
+
+int lmem_in_region(void *p) {
+    return (((size_t *)p - 1)[0] & LMEM_REGION) != 0;
+}
+
+void lmem_free(void *p) {
+    if (!p) return;
+
+    size_t *block = (size_t *)p - 1;
+    size_t c = block[0] & ~LMEM_REGION;
+    lmem_stats.live--;
+
+    if (block[0] & LMEM_REGION) {
+        region.lmem_live--;
+        if (c <= LMEM_MAX_CLASS) lregion_recycle(&region.lmem_free[c], block);
+        return;
+    }
+
+#ifndef JLISP_NO_POOL
+    if (c <= LMEM_MAX_CLASS) {
+        *(void **)p = lmem_free_lists[c];
+        lmem_free_lists[c] = block;
+        return;
+    }
+#endif
+    free(block);
+}
+
+// usable bytes in a block
+size_t lmem_size(void *p) {
+    size_t c = ((size_t *)p - 1)[0] & ~LMEM_REGION;
+    return ((size_t)1 << c) - sizeof(size_t);
+}
+
+// a block that moves stays in the region or on the heap, whichever it
+// was in before
+void *lmem_realloc(void *p, size_t size) {
+    if (!p) return lmem_alloc(size);
+
+    // block is already big enough
+    if (size <= lmem_size(p)) return p;
+
+    void *n = lmem_alloc_in(size, lmem_in_region(p));
+    memcpy(n, p, lmem_size(p));
+    lmem_free(p);
+    return n;
+}
+
+int lval_is_region(lval *v) {
+    return (v->flags & LALLOC_REGION) != 0;
+}
+
+// copy of a string in array memory
+char *lstr_dup(char *s) {
+    size_t n = strlen(s) + 1;
+    char *x = lmem_alloc(n);
+    memcpy(x, s, n);
+    return x;
+}
+
+unsigned long lhash_mix(unsigned long h, unsigned long x) {
+    h ^= x;
+    h *= 0x100000001b3UL;
+    return h ^ (h >> 29);
+}
+
+unsigned long lhash_bytes(char *s, int len) {
+    unsigned long h = 0xcbf29ce484222325UL;
+    for (int i = 0; i < len; i++) h = lhash_mix(h, (unsigned char)s[i]);
+    return h;
+}
+
+// NULL if out of memory
+lval *lval_alloc(int type) {
+    lval *v;
+    if (region.active) {
+        v = lregion_reuse(&region.lval_free);
+        if (!v) v = lregion_alloc(sizeof(lval));
+        if (!v) return NULL;
+        v->flags = LALLOC_REGION;
+        region.lval_live[type]++;
+    } else {
+        v = lpool_alloc(&lval_pool);
+        if (!v) return NULL;
+        v->flags = 0;
+    }
+    v->type = type;
+    v->refs = 0;
+    lstat_add(&lval_stats[type]);
+    return v;
+}
+
+void lval_free(lval *v) {
+    lval_stats[v->type].live--;
+    if (lval_is_region(v)) {
+        region.lval_live[v->type]--;
+        lregion_recycle(&region.lval_free, v);
+    } else {
+        lpool_free(&lval_pool, v);
+    }
+}
+
+// change type in place, keeping the counters by type right
+void lval_retype(lval *v, int type) {
+    lval_stats[v->type].live--;
+    lval_stats[type].live++;
+    if (lval_stats[type].live > lval_stats[type].peak) {
+        lval_stats[type].peak = lval_stats[type].live;
+    }
+    if (lval_is_region(v)) {
+        region.lval_live[v->type]--;
+        region.lval_live[type]++;
+    }
+    v->type = type;
+}
+
+lenv *lenv_alloc() {
+    lenv *e;
+    if (region.active) {
+        e = lregion_reuse(&region.lenv_free);
+        if (!e) e = lregion_alloc(sizeof(lenv));
+        if (!e) return NULL;
+        e->flags = LALLOC_REGION;
+        region.lenv_live++;
+    } else {
+        e = lpool_alloc(&lenv_pool);
+        if (!e) return NULL;
+        e->flags = 0;
+    }
+    lstat_add(&lenv_stats);
+    return e;
+}
+
+void lenv_free(lenv *e) {
+    lenv_stats.live--;
+    if (e->flags & LALLOC_REGION) {
+        region.lenv_live--;
+        lregion_recycle(&region.lenv_free, e);
+    } else {
+        lpool_free(&lenv_pool, e);
+    }
+}
+
+// a region list sharing a heap buffer keeps it alive until lregion_end
+void lbuf_pin(lbuf *b) {
+    if (b->pinned++ == 0) {
+        if (region.pinned_count == region.pinned_capacity) {
+            region.pinned_capacity = region.pinned_capacity ?
+                region.pinned_capacity * 2 : 16;
+            region.pinned = realloc(region.pinned,
+                    sizeof(lbuf *) * region.pinned_capacity);
+        }
+        region.pinned[region.pinned_count++] = b;
+    }
+    b->refs++;
+}
+
+void lbuf_free(lbuf *b);
+
+// Start allocating from the region, returns 0 if one is already active
+int lregion_begin() {
+#ifdef JLISP_NO_POOL
+    return 0;
+#endif
+    if (region.active) return 0;
+    region.active = 1;
+    return 1;
+}
+
+// Drop everything allocated since lregion_begin
+void lregion_end() {
+    region.active = 0;
+
+    for (int i = 0; i < region.pinned_count; i++) {
+        lbuf *b = region.pinned[i];
+        b->refs -= b->pinned;
+        b->pinned = 0;
+        if (b->refs == 0) lbuf_free(b);
+    }
+    region.pinned_count = 0;
 
-long pow_long(long x, long n) {
-    if (n <= 0) return 1;
+    for (int t = 0; t <= LVAL_SEQ; t++) {
+        lval_stats[t].live -= region.lval_live[t];
+        region.lval_live[t] = 0;
+    }
+    lenv_stats.live -= region.lenv_live;
+    lmem_stats.live -= region.lmem_live;
+    region.lenv_live = 0;
+    region.lmem_live = 0;
+
+    region.lval_free = NULL;
+    region.lenv_free = NULL;
+    memset(region.lmem_free, 0, sizeof(region.lmem_free));
+
+    // keep the oldest chunk for the next form
+    char *keep = NULL;
+    while (region.chunks) {
+        char *next = *(void **)region.chunks;
+        if (next) free(region.chunks); else keep = region.chunks;
+        region.chunks = next;
+    }
+    region.chunks = keep;
+    region.next = keep ? keep + sizeof(void *) : NULL;
+    region.end = keep ? region.next + LREGION_CHUNK : NULL;
+}
 
+// Set *r to x to the power n and return 0, or return 1 on overflow
+int pow_long(long x, long n, long *r) {
     long res = 1;
-    for (int i = 0; i < n; i++) res *= x; 
-    return res;
+    for (long i = 0; i < n; i++) {
+        if (__builtin_mul_overflow(res, x, &res)) return 1;
+    }
+    *r = res;
+    return 0;
+}
+
+// Set *r to x / y and return 0, or return 1 if that has no result
+int div_long(long x, long y, long *r) {
+    if (y == 0 || (x == LONG_MIN && y == -1)) return 1;
+    *r = x / y;
+    return 0;
+}
+
+
+// Give v the text of the len bytes at s, with its length and hash
+void lval_set_text(lval *v, char *s, int len) {
+    v->len = len;
+    v->hash = lhash_bytes(s, len);
+    if (len < LSTR_SMALL) {
+        v->shared = NULL;
+        v->str = v->chars;
+    } else {
+        v->shared = lmem_alloc_in(sizeof(lstrbuf) + len + 1,
+                lval_is_region(v));
+        v->shared->refs = 1;
+        v->str = v->shared->chars;
+    }
+    memcpy(v->str, s, len);
+    v->str[len] = '\0';
+}
+
+// Copy text of v into x, sharing a long string's buffer where the copy
+// does not outlive it
+void lval_copy_text(lval *x, lval *v) {
+    lstrbuf *b = v->shared;
+    if (b && (lval_is_region(x) || !lmem_in_region(b))) {
+        b->refs++;
+        x->shared = b;
+        x->len = v->len;
+        x->hash = v->hash;
+        x->str = b->chars;
+        return;
+    }
+    lval_set_text(x, v->str, v->len);
+}
+
+void lval_del_text(lval *v) {
+    if (v->shared && --v->shared->refs == 0) lmem_free(v->shared);
 }
 
+int lval_text_eq(lval *x, lval *y) {
+    return x->len == y->len && x->hash == y->hash &&
+        memcmp(x->str, y->str, x->len) == 0;
+}
 
 // create lval of type num
 lval *lval_num(long x) {
-    lval *v = malloc(sizeof(lval));
-    v->type = LVAL_NUM;
+    lval *v = lval_alloc(LVAL_NUM);
     v->num = x;
     return v;
 }
 
+// Next conversion in an error format, advancing *f past it
+// Returns 's' for strings, 'l' for longs, 'i' for ints, 0 at the end.
+char lerr_conv(char **f) {
+    char *s = *f;
+    while ((s = strchr(s, '%'))) {
+        if (s[1] == '%') {
+            s += 2;
+            continue;
+        }
+        s++;
+        char c = *s == 'l' ? 'l' : 'i';
+        while (*s && !strchr("sdi", *s)) s++;
+        if (*s == 's') c = 's';
+        *f = *s ? s + 1 : s;
+        return c;
+    }
+    return 0;
+}
+
+void lerr_free_args(char *fmt, lerr_arg *args) {
+    char c;
+    for (int n = 0; (c = lerr_conv(&fmt)); n++) {
+        if (c == 's') lmem_free(args[n].str);
+    }
+}
+
+// Preallocated error for when there is no memory to report one
+static __thread lval lval_oom_v = { .type = LVAL_ERR,
+    .flags = LALLOC_IMMORTAL };
+
+lval *lval_oom() {
+    if (!lval_oom_v.err) lval_set_text(&lval_oom_v, "Out of memory", 13);
+    return &lval_oom_v;
+}
+
 // create lval of type err
+// Only the format and arguments are kept, the message is formatted by
+// lval_err_text if the error is ever printed or compared.
 lval *lval_err(char *fmt, ...) {
-    lval *v = malloc(sizeof(lval));
-    v->type = LVAL_ERR;
+    lval *v = lval_alloc(LVAL_ERR);
+    if (!v) return lval_oom();
 
     // create and initialize va list
     va_list va;
     va_start(va, fmt);
 
-    v->err = malloc(512);
-
-    vsnprintf(v->err, 511, fmt, va);
+    int n = 0;
+    char c;
+    for (char *f = fmt; lerr_conv(&f); ) n++;
 
-    v->err = realloc(v->err, strlen(v->err) + 1);
+    if (n > LERR_ARGS) {
+        char buffer[512];
+        int len = vsnprintf(buffer, 511, fmt, va);
+        lval_set_text(v, buffer, len < 511 ? len : 510);
+    } else {
+        v->err = NULL;
+        v->fmt = fmt;
+        n = 0;
+        for (char *f = fmt; (c = lerr_conv(&f)); n++) {
+            if (c == 's') v->args[n].str = lstr_dup(va_arg(va, char *));
+            if (c == 'l') v->args[n].num = va_arg(va, long);
+            if (c == 'i') v->args[n].num = va_arg(va, int);
+        }
+    }
 
     va_end(va);
     return v;
 }
 
+// message of an error, formatting it on first use
+char *lval_err_text(lval *v) {
+    if (v->err) return v->err;
+
+    char *fmt = v->fmt;
+    lerr_arg args[LERR_ARGS];
+    memcpy(args, v->args, sizeof(args));
+
+    char buffer[512];
+    int n = 0;
+    int i = 0;
+    char *f = fmt;
+    while (*f && n < 511) {
+        if (*f != '%') {
+            buffer[n++] = *f++;
+            continue;
+        }
+        if (f[1] == '%') {
+            buffer[n++] = '%';
+            f += 2;
+            continue;
+        }
+
+        // one conversion at a time, with the type it was given as
+        char spec[8];
+        int k = 0;
+        while (*f && !strchr("sdi", *f) && k < 6) spec[k++] = *f++;
+        if (*f) spec[k++] = *f++;
+        spec[k] = '\0';
+
+        char *c = spec;
+        int w;
+        switch (lerr_conv(&c)) {
+            case 's': w = snprintf(buffer + n, 512 - n, spec, args[i].str);
+                break;
+            case 'l': w = snprintf(buffer + n, 512 - n, spec, args[i].num);
+                break;
+            default: w = snprintf(buffer + n, 512 - n, spec, (int)args[i].num);
+                break;
+        }
+        i++;
+        n += w;
+        if (n > 511) n = 511;
+    }
+
+    lerr_free_args(fmt, args);
+    lval_set_text(v, buffer, n);
+    return v->err;
+}
+
 // create lval of type symbol
 lval *lval_sym(char *s) {
-    lval *v = malloc(sizeof(lval));
-    v->type = LVAL_SYM;
-    v->sym = malloc(sizeof(strlen(s)) + 1);
-    strcpy(v->sym, s);
+    lval *v = lval_alloc(LVAL_SYM);
+    lval_set_text(v, s, strlen(s));
+    v->depth = LSLOT_NONE;
     return v;
 }
 
 lval *lval_str(char *s) {
-    lval *v = malloc(sizeof(lval));
-    v->type = LVAL_STR;
-    v->str = malloc(strlen(s) + 1);
-    strcpy(v->str, s);
+    lval *v = lval_alloc(LVAL_STR);
+    lval_set_text(v, s, strlen(s));
     return v;
 }
 
 lval *lval_fun(lbuiltin func) {
-    lval *v = malloc(sizeof(lval));
-    v->type = LVAL_FUN;
+    lval *v = lval_alloc(LVAL_FUN);
     v->builtin = func;
+    v->desc = NULL;
+    v->bound = NULL;
+    return v;
+}
+
+// Partial application of lambda fn to arguments bound, which only
+// holds on to fn instead of copying it
+lval *lval_partial(lval *fn, lval *bound) {
+    lval *v = lval_alloc(LVAL_FUN);
+    v->builtin = NULL;
+    v->bound = bound;
+    v->fn = lval_retain(fn);
     return v;
 }
 
 lval *lval_lambda(lval *formals, lval *body) {
-    lval *v = malloc(sizeof(lval));
-    v->type = LVAL_FUN;
+    lval *v = lval_alloc(LVAL_FUN);
 
     // Not builtin
     v->builtin = NULL;
+    v->bound = NULL;
 
     v->env = lenv_new();
 
@@ -196,21 +939,101 @@ lval *lval_lambda(lval *formals, lval *body) {
 }
 
 
+// Immortal values
+// Builtins, nil, true and false are preallocated and every reference to
+// them shares the one object. They are never copied or freed and compare
+// by identity, so code modifying a value it was handed must lval_own it.
+
+#define LVAL_IMMORTAL_MAX 128
+
+static __thread lval lval_immortals[LVAL_IMMORTAL_MAX];
+static __thread int lval_immortal_count;
+
+// these stand in for the literals {}, 1 and 0, see lval_intern
+static __thread lval lval_nil_v = { .type = LVAL_QEXPR,
+    .flags = LALLOC_IMMORTAL | LALLOC_INTERNED };
+static __thread lval lval_true_v = { .type = LVAL_NUM,
+    .flags = LALLOC_IMMORTAL | LALLOC_INTERNED, .num = 1 };
+static __thread lval lval_false_v = { .type = LVAL_NUM,
+    .flags = LALLOC_IMMORTAL | LALLOC_INTERNED, .num = 0 };
+
+lval *lval_nil() {
+    return &lval_nil_v;
+}
+
+lval *lval_bool(int x) {
+    return x ? &lval_true_v : &lval_false_v;
+}
+
+// immortal builtin function, taken from the static table
+lval *lval_builtin(const ldesc *d) {
+    if (lval_immortal_count == LVAL_IMMORTAL_MAX) {
+        fprintf(stderr, "Too many builtins, raise LVAL_IMMORTAL_MAX\n");
+        exit(1);
+    }
+    lval *v = &lval_immortals[lval_immortal_count++];
+    v->type = LVAL_FUN;
+    v->flags = LALLOC_IMMORTAL;
+    v->builtin = d->func;
+    v->desc = d;
+    v->bound = NULL;
+    return v;
+}
+
+int lval_is_immortal(lval *v) {
+    return (v->flags & LALLOC_IMMORTAL) != 0;
+}
+
+int lval_is_interned(lval *v) {
+    return (v->flags & LALLOC_INTERNED) != 0;
+}
+
+// Share v with another owner instead of copying it
+// Every owner deletes it once. Retained values must not be modified,
+// code that changes a value it was handed takes it with lval_own.
+lval *lval_retain(lval *v) {
+    if (!lval_is_immortal(v)) v->refs++;
+    return v;
+}
+
+// copy of a list item or function part, interned values never change
+// so they are shared instead
+lval *lval_copy_child(lval *v) {
+    return lval_is_interned(v) ? lval_retain(v) : lval_copy(v);
+}
+
 // create lval of type Sexpr (list of expressions)
 lval *lval_sexpr() {
-    lval *v = malloc(sizeof(lval));
+    lval *v = lval_alloc(LVAL_SEXPR);
+    v->code = NULL;
+    v->count = 0;
+    v->cell = NULL;
+    v->buf = NULL;
+    return v;
+}
+
+// Empty S-expression in v, a scratch list on the caller's stack
+// Deleting it deletes its items, the list itself goes with the frame.
+// Only lists that do not outlive the call they are built for may be
+// scratch, see LNODE_SCRATCH.
+lval *lval_scratch(lval *v) {
     v->type = LVAL_SEXPR;
+    v->flags = LALLOC_SCRATCH;
+    v->refs = 0;
+    v->code = NULL;
     v->count = 0;
     v->cell = NULL;
+    v->buf = NULL;
     return v;
 }
 
 // create lval of type Qexpr 
 lval *lval_qexpr() {
-    lval *v = malloc(sizeof(lval));
-    v->type = LVAL_QEXPR;
+    lval *v = lval_alloc(LVAL_QEXPR);
+    v->code = NULL;
     v->count = 0;
     v->cell = NULL;
+    v->buf = NULL;
     return v;
 }
 
@@ -223,115 +1046,451 @@ char *ltype_name(int t) {
         case LVAL_STR: return "String";
         case LVAL_SEXPR: return "S-Expression";
         case LVAL_QEXPR: return "Q-Expression";
+        case LVAL_SEQ: return "Sequence";
         default: return "Unknown";
     }
 }
 
 void lval_del(lval *v) {
+    if (lval_is_immortal(v)) return;
+    // drop one owner of a retained value
+    if (v->refs) {
+        v->refs--;
+        return;
+    }
 
     switch (v->type) {
 
         case LVAL_NUM: 
             break;
-        case LVAL_ERR: free(v->err);
-            break;
-        case LVAL_SYM: free(v->sym);
-            break;
-        case LVAL_STR: free(v->str);
+        case LVAL_ERR:
+            if (!v->err) {
+                lerr_free_args(v->fmt, v->args);
+                break;
+            }
+            // fall through
+        case LVAL_SYM:
+        case LVAL_STR: lval_del_text(v);
             break;
         case LVAL_QEXPR:
         case LVAL_SEXPR:
-            for (int i = 0; i < v->count; i++) {
-                lval_del(v->cell[i]);
+            if (v->buf) {
+                lval_drop_buf(v);
+            } else {
+                for (int i = 0; i < v->count; i++) lval_del(v->cell[i]);
             }
-            free(v->cell);
             break;
         case LVAL_FUN: 
-            if (!v->builtin) {
+            if (v->bound) {
+                lval_del(v->bound);
+                if (!v->builtin) lval_del(v->fn);
+            } else if (!v->builtin) {
                 lenv_del(v->env);
                 lval_del(v->formals);
                 lval_del(v->body);
             }
             break;
+        case LVAL_SEQ:
+            if (v->gen) lval_del(v->gen);
+            if (v->src) lval_del(v->src);
+            break;
+    }
+    if (!(v->flags & LALLOC_SCRATCH)) lval_free(v);
+}
+
+// new buffer for list v, kept in the region if v is
+lbuf *lbuf_new(lval *v, int capacity) {
+    lbuf *b = lmem_alloc_in(sizeof(lbuf) + sizeof(lval*) * capacity,
+            lval_is_region(v));
+    b->refs = 1;
+    b->pinned = 0;
+    b->start = 0;
+    b->end = 0;
+    // use whatever the size class rounded up to
+    b->capacity = (lmem_size(b) - sizeof(lbuf)) / sizeof(lval*);
+    return b;
+}
+
+// free a buffer and the items it owns
+void lbuf_free(lbuf *b) {
+    for (int i = b->start; i < b->end; i++) {
+        lval_del(b->items[i]);
+    }
+    lmem_free(b);
+}
+
+// a region list never modifies a heap buffer, it may be pinned
+int lval_shared(lval *v) {
+    return v->buf->refs > 1 ||
+        (lval_is_region(v) && !lmem_in_region(v->buf));
+}
+
+// give up the reference v holds on its buffer
+void lval_drop_buf(lval *v) {
+    // references from the region to heap buffers are dropped by lregion_end
+    if (lval_is_region(v) && !lmem_in_region(v->buf)) return;
+    if (--v->buf->refs == 0) lbuf_free(v->buf);
+}
+
+// Make v the only owner of its buffer, and the buffer hold only the
+// items v can see, so that it can be modified in place
+void lval_unshare(lval *v) {
+    lbuf *b = v->buf;
+    if (!b) return;
+
+    if (lval_shared(v)) {
+        lbuf *n = lbuf_new(v, v->count);
+        for (int i = 0; i < v->count; i++) {
+            n->items[i] = lval_copy_child(v->cell[i]);
+        }
+        n->end = v->count;
+        lval_drop_buf(v);
+
+        v->buf = n;
+        v->cell = n->items;
+        return;
+    }
+
+    // delete items sliced off while the buffer was shared
+    int start = v->cell - b->items;
+    int end = start + v->count;
+    for (int i = b->start; i < start; i++) lval_del(b->items[i]);
+    for (int i = end; i < b->end; i++) lval_del(b->items[i]);
+    b->start = start;
+    b->end = end;
+}
+
+// make room for n more items at the end of the cell array
+void lval_reserve(lval *v, int n) {
+    lbuf *b = v->buf;
+
+    // a list ending where its buffer does can append even when shared,
+    // the new items are outside every other list's slice
+    if (b && v->cell + v->count == b->items + b->end &&
+            b->end + n <= b->capacity &&
+            lval_is_region(v) == lmem_in_region(b)) return;
+
+    lval_unshare(v);
+    b = v->buf;
+
+    if (!b && v->count + n <= LVAL_SMALL) {
+        v->cell = v->small;
+        return;
+    }
+
+    if (!b) {
+        // spill the inline cells into a buffer
+        int capacity = LVAL_SMALL * 2;
+        while (capacity < v->count + n) capacity *= 2;
+        b = lbuf_new(v, capacity);
+        memcpy(b->items, v->cell, sizeof(lval*) * v->count);
+        b->end = v->count;
+    } else if (b->end + n <= b->capacity) {
+        return;
+    } else if (v->count + n <= b->capacity && b->start >= b->capacity / 2) {
+        // reuse space left by popping from the front
+        memmove(b->items, v->cell, sizeof(lval*) * v->count);
+        b->start = 0;
+        b->end = v->count;
+    } else {
+        // otherwise grow geometrically
+        int capacity = b->capacity * 2;
+        while (capacity < b->end + n) capacity *= 2;
+        b = lmem_realloc(b, sizeof(lbuf) + sizeof(lval*) * capacity);
+        b->capacity = (lmem_size(b) - sizeof(lbuf)) / sizeof(lval*);
     }
-    free(v);
+
+    v->buf = b;
+    v->cell = b->items + b->start;
 }
 
 lval *lval_add(lval *v, lval *x) {
-    v->count++;
-    v->cell = realloc(v->cell, sizeof(lval*) * v->count);
-    v->cell[v->count - 1] = x;
+    lval_reserve(v, 1);
+    v->cell[v->count++] = x;
+    if (v->buf) v->buf->end++;
     return v;
 }
 
+// v for a copy x to hold, shared unless a heap copy would outlive it
+// in the region
+lval *lval_copy_into(lval *x, lval *v) {
+    return lval_is_region(x) || !lval_is_region(v) ?
+        lval_retain(v) : lval_copy(v);
+}
+
 // Deep Copy
 lval *lval_copy(lval *v) {
+    if (lval_is_immortal(v)) return v;
 
-    lval *x = malloc(sizeof(lval));
-    x->type = v->type;
+    lval *x = lval_alloc(v->type);
 
     switch (v->type) {
         case LVAL_FUN: 
             if (v->builtin) {
-            x->builtin = v->builtin;
+                x->builtin = v->builtin;
+                x->desc = v->desc;
+                x->bound = v->bound ? lval_copy(v->bound) : NULL;
+            } else if (v->bound) {
+                // the lambda is shared where the copy does not outlive it
+                x->builtin = NULL;
+                x->bound = lval_copy(v->bound);
+                x->fn = lval_copy_into(x, v->fn);
             } else {
                 x->builtin = NULL;
+                x->bound = NULL;
                 x->env = lenv_copy(v->env);
-                x->formals = lval_copy(v->formals);
-                x->body = lval_copy(v->body);
+                x->formals = lval_copy_child(v->formals);
+                x->body = lval_copy_child(v->body);
             }
             break;
         case LVAL_NUM: x->num = v->num;
             break;
 
-        case LVAL_ERR: 
-            x->err = malloc(strlen(v->err) + 1);
-            strcpy(x->err, v->err);
-            break;
-
+        case LVAL_ERR: lval_err_text(v);
+            // fall through
         case LVAL_SYM:
-            x->sym = malloc(strlen(v->sym) + 1);
-            strcpy(x->sym, v->sym);
-            break;
-
-        case LVAL_STR:
-            x->str = malloc(strlen(v->str) + 1);
-            strcpy(x->str, v->str);
+        case LVAL_STR: lval_copy_text(x, v);
+            x->depth = LSLOT_NONE;
             break;
 
         case LVAL_SEXPR:
         case LVAL_QEXPR:
+            x->code = NULL;
             x->count = v->count;
-            x->cell = malloc(sizeof(lval *) * x->count);
+
+            // large Q-expressions share their items, except that
+            // heap copies of region lists need their own
+            if (v->type == LVAL_QEXPR && v->count >= LBUF_SHARE_MIN &&
+                    (region.active || !lmem_in_region(v->buf))) {
+                x->buf = v->buf;
+                x->cell = v->cell;
+                if (region.active && !lmem_in_region(v->buf)) {
+                    lbuf_pin(v->buf);
+                } else {
+                    v->buf->refs++;
+                }
+                break;
+            }
+
+            x->buf = x->count > LVAL_SMALL ? lbuf_new(x, x->count) : NULL;
+            x->cell = x->buf ? x->buf->items : x->small;
             for (int i = 0; i < x->count; i ++) {
-                x->cell[i]= lval_copy(v->cell[i]);
+                x->cell[i]= lval_copy_child(v->cell[i]);
             }
+            if (x->buf) x->buf->end = x->count;
+            break;
+
+        case LVAL_SEQ:
+            x->seq = v->seq;
+            x->from = v->from;
+            x->to = v->to;
+            x->gen = v->gen ? lval_copy_into(x, v->gen) : NULL;
+            x->src = v->src ? lval_copy_into(x, v->src) : NULL;
             break;
     }
     return x;
 }
 
+// v itself if it may be modified, otherwise a copy that may
+lval *lval_own(lval *v) {
+    if (v->refs) {
+        v->refs--;
+        return lval_copy(v);
+    }
+    if (!lval_is_immortal(v)) return v;
 
-int lval_eq(lval *x, lval *y) {
+    switch (v->type) {
+        case LVAL_NUM: return lval_num(v->num);
+        case LVAL_QEXPR: return lval_qexpr();
+        case LVAL_FUN: {
+            lval *x = lval_fun(v->builtin);
+            x->desc = v->desc;
+            return x;
+        }
+    }
+    return v;
+}
 
-    if (x->type != y->type) return 0;
 
-    switch (x->type) {
-        case LVAL_NUM: return (x->num == y->num);
+// Interned literals
+// Literal Q-expressions are hash-consed as they are read: every atom and
+// sub-list in them is replaced by the one heap copy of its value held by
+// the intern table, so equal literals are the same object wherever they
+// appear. Interned values are shared with lval_retain and never freed.
 
-        // String values
-        case LVAL_ERR: return (strcmp(x->err, y->err) == 0);
-        case LVAL_SYM: return (strcmp(x->sym, y->sym) == 0);
-        case LVAL_STR: return (strcmp(x->str, y->str) == 0);
+typedef struct ltable {
+    lval **items;
+    int count;
+    int capacity; // power of two
+} ltable;
+
+static __thread ltable interned;
+
+// items of an interned list are interned, so the list hashes and
+// compares them by address
+unsigned long lval_hash(lval *v) {
+    switch (v->type) {
+        case LVAL_NUM: return lhash_mix(LVAL_NUM, v->num);
+        case LVAL_SYM:
+        case LVAL_STR: return lhash_mix(v->type, v->hash);
+        case LVAL_SEXPR:
+        case LVAL_QEXPR:
+            if (lval_is_interned(v)) return v->hash;
+            unsigned long h = lhash_mix(v->type, v->count);
+            for (int i = 0; i < v->count; i++) {
+                h = lhash_mix(h, (unsigned long)v->cell[i]);
+            }
+            return h;
+    }
+    return 0;
+}
+
+int lval_same_shallow(lval *x, lval *y) {
+    if (x->type != y->type) return 0;
+    switch (x->type) {
+        case LVAL_NUM: return x->num == y->num;
+        case LVAL_SYM:
+        case LVAL_STR: return lval_text_eq(x, y);
+        case LVAL_SEXPR:
+        case LVAL_QEXPR:
+            if (x->count != y->count) return 0;
+            for (int i = 0; i < x->count; i++) {
+                if (x->cell[i] != y->cell[i]) return 0;
+            }
+            return 1;
+    }
+    return 0;
+}
+
+void ltable_grow(ltable *t) {
+    int capacity = t->capacity ? t->capacity * 2 : 256;
+    lval **items = calloc(capacity, sizeof(lval *));
+    for (int i = 0; i < t->capacity; i++) {
+        lval *v = t->items[i];
+        if (!v) continue;
+        int j = lval_hash(v) & (capacity - 1);
+        while (items[j]) j = (j + 1) & (capacity - 1);
+        items[j] = v;
+    }
+    free(t->items);
+    t->items = items;
+    t->capacity = capacity;
+}
+
+// Take v and return the interned value equal to it
+// Values that cannot be interned, like errors, are returned as they are.
+lval *lval_intern(lval *v) {
+    if (lval_is_interned(v)) return v;
+
+    switch (v->type) {
+        case LVAL_NUM:
+            if (v->num == 0 || v->num == 1) {
+                lval *b = lval_bool(v->num);
+                lval_del(v);
+                return b;
+            }
+            break;
+        case LVAL_SYM:
+        case LVAL_STR:
+            break;
+        case LVAL_SEXPR:
+        case LVAL_QEXPR: {
+            int ok = true;
+            for (int i = 0; i < v->count; i++) {
+                v->cell[i] = lval_intern(v->cell[i]);
+                if (!lval_is_interned(v->cell[i])) ok = false;
+            }
+            if (!ok) return v;
+            if (v->type == LVAL_QEXPR && v->count == 0) {
+                lval_del(v);
+                return lval_nil();
+            }
+            break;
+        }
+        default:
+            return v;
+    }
+
+    if (interned.count * 2 >= interned.capacity) ltable_grow(&interned);
+
+    unsigned long h = lval_hash(v);
+    int i = h & (interned.capacity - 1);
+    while (interned.items[i]) {
+        if (lval_same_shallow(interned.items[i], v)) {
+            lval_del(v);
+            return lval_retain(interned.items[i]);
+        }
+        i = (i + 1) & (interned.capacity - 1);
+    }
+
+    // first of its value, keep a heap copy in the table
+    int active = region.active;
+    region.active = 0;
+    lval *x;
+    switch (v->type) {
+        case LVAL_NUM: x = lval_num(v->num); break;
+        case LVAL_SYM:
+        case LVAL_STR:
+            x = lval_alloc(v->type);
+            lval_copy_text(x, v);
+            x->depth = LSLOT_NONE;
+            break;
+        default:
+            x = v->type == LVAL_QEXPR ? lval_qexpr() : lval_sexpr();
+            for (int j = 0; j < v->count; j++) {
+                x = lval_add(x, lval_retain(v->cell[j]));
+            }
+            x->hash = h;
+            break;
+    }
+    region.active = active;
+    lval_del(v);
+
+    x->flags |= LALLOC_INTERNED;
+    interned.items[i] = x;
+    interned.count++;
+    return lval_retain(x);
+}
+
+
+int lval_eq(lval *x, lval *y) {
+
+    if (x == y) return 1;
+    // an interned value is the only interned one equal to itself
+    if (lval_is_interned(x) && lval_is_interned(y)) return 0;
+    if (x->type != y->type) return 0;
+
+    switch (x->type) {
+        case LVAL_NUM: return (x->num == y->num);
+
+        // String values
+        case LVAL_ERR:
+            lval_err_text(x);
+            lval_err_text(y);
+            // fall through
+        case LVAL_SYM:
+        case LVAL_STR: return lval_text_eq(x, y);
 
         // compare builtins as function pointers
         // otherwise compare formals and body
         case LVAL_FUN:
             if (x->builtin || y->builtin) {
-                return x->builtin == y->builtin;
+                if (x->builtin != y->builtin) return 0;
+                if (!x->bound || !y->bound) return x->bound == y->bound;
+                return lval_eq(x->bound, y->bound);
             } else {
-                return lval_eq(x->formals, y->formals) &&
-                lval_eq(x->body, y->body);
+                // partial applications by the formals they leave
+                int i = x->bound ? x->bound->count : 0;
+                int j = y->bound ? y->bound->count : 0;
+                lval *fx = x->bound ? x->fn : x;
+                lval *fy = y->bound ? y->fn : y;
+                if (fx->formals->count - i != fy->formals->count - j) return 0;
+                for (; i < fx->formals->count; i++, j++) {
+                    if (!lval_eq(fx->formals->cell[i], fy->formals->cell[j])) {
+                        return 0;
+                    }
+                }
+                return lval_eq(fx->body, fy->body);
             }
 
         // compare elements of list
@@ -343,6 +1502,23 @@ int lval_eq(lval *x, lval *y) {
             }
             // otherwise they are equal
             return 1;
+
+        // a sequence only equals itself, see lval_has_seq
+        case LVAL_SEQ: return 0;
+    }
+    return 0;
+}
+
+// 1 if v is or holds a sequence, whose elements are only known by
+// walking it, which may never end, so == refuses to compare it
+int lval_has_seq(lval *v) {
+    if (lval_is_interned(v)) return 0;
+    if (v->type == LVAL_SEQ) return 1;
+    if (v->type == LVAL_FUN) return v->bound && lval_has_seq(v->bound);
+    if (v->type == LVAL_QEXPR || v->type == LVAL_SEXPR) {
+        for (int i = 0; i < v->count; i++) {
+            if (lval_has_seq(v->cell[i])) return 1;
+        }
     }
     return 0;
 }
@@ -366,6 +1542,17 @@ lval *lval_read_str(mpc_ast_t *t) {
     return str;
 }
 
+// brackets, comments and anchors are not expressions
+int lval_read_skip(mpc_ast_t *t) {
+    if (strcmp(t->contents, "(") == 0) return true;
+    if (strcmp(t->contents, ")") == 0) return true;
+    if (strcmp(t->contents, "{") == 0) return true;
+    if (strcmp(t->contents, "}") == 0) return true;
+    if (strcmp(t->tag, "regex") == 0) return true;
+    if (strstr(t->tag, "comment")) return true;
+    return false;
+}
+
 lval *lval_read(mpc_ast_t *t) {
     // symbol number or string
     if (strstr(t->tag, "number")) return lval_read_num(t);
@@ -381,22 +1568,19 @@ lval *lval_read(mpc_ast_t *t) {
 
     // fill list with valid expressions
     for (int i = 0; i < t->children_num; i++) {
-        if (strcmp(t->children[i]->contents, "(") == 0) continue;
-        if (strcmp(t->children[i]->contents, ")") == 0) continue;
-        if (strcmp(t->children[i]->contents, "{") == 0) continue;
-        if (strcmp(t->children[i]->contents, "}") == 0) continue;
-        if (strcmp(t->children[i]->tag, "regex") == 0) continue;
-        if (strstr(t->children[i]->tag, "comment")) continue;
+        if (lval_read_skip(t->children[i])) continue;
         
         x = lval_add(x, lval_read(t->children[i]));
     }
 
+    // literal Q-expressions are shared by every occurrence
+    if (x->type == LVAL_QEXPR) x = lval_intern(x);
     return x;
 }
 
 // print string with proper escape characters and formatting
 void lval_print_str(lval *v) {
-    char *escaped = malloc(strlen(v->str) + 1);
+    char *escaped = malloc(v->len + 1);
     strcpy(escaped, v->str);
     escaped = mpcf_escape(escaped);
 
@@ -420,7 +1604,7 @@ void lval_print(lval *v) {
     switch (v->type) {
         case LVAL_NUM: printf("%li", v->num);
             break;
-        case LVAL_ERR: printf("Error: %s", v->err);
+        case LVAL_ERR: printf("Error: %s", lval_err_text(v));
             break;
         case LVAL_SYM: printf("%s", v->sym);
             break;
@@ -430,14 +1614,22 @@ void lval_print(lval *v) {
             break;
         case LVAL_QEXPR: lval_expr_print(v, '{', '}');
             break;
+        case LVAL_SEQ: printf("<sequence>");
+            break;
         case LVAL_FUN: 
             if (v->builtin) {
                 printf("<function>");
             } else {
-                printf(" (\\ ");
-                lval_print(v->formals);
-                putchar(' ');
-                lval_print(v->body);
+                // a partial application shows the formals it leaves
+                lval *f = v->bound ? v->fn : v;
+                int i = v->bound ? v->bound->count : 0;
+                printf(" (\\ {");
+                for (; i < f->formals->count; i++) {
+                    lval_print(f->formals->cell[i]);
+                    if (i != f->formals->count - 1) putchar(' ');
+                }
+                printf("} ");
+                lval_print(f->body);
                 putchar(' ');
             }
             break;
@@ -451,17 +1643,45 @@ void lval_println(lval *v) {
 
 lval *lval_pop(lval *v, int i) {
 
-    lval *x = v->cell[i];
-    
-    // shift memory after i back one
-    memmove(&v->cell[i], &v->cell[i+1],
-            sizeof(lval*) * (v->count - i-1));
+    // the front of a shared list is sliced off and copied
+    if (i == 0 && v->buf && lval_shared(v)) {
+        lval *x = lval_copy(v->cell[0]);
+        v->cell++;
+        v->count--;
+        return x;
+    }
 
+    lval_unshare(v);
+    lval *x = v->cell[i];
     v->count--;
-    v->cell = realloc(v->cell, sizeof(lval*) * v->count);
+
+    if (i == 0 && v->buf) {
+        // popping the front just moves the start
+        v->cell++;
+        v->buf->start++;
+    } else {
+        // shift memory after i back one
+        memmove(&v->cell[i], &v->cell[i+1],
+                sizeof(lval*) * (v->count - i));
+        if (v->buf) v->buf->end--;
+    }
+
     return x;
 }
 
+// delete every item from index n onwards
+void lval_truncate(lval *v, int n) {
+    if (n >= v->count) return;
+
+    // a shared list only narrows its slice
+    if (!v->buf || !lval_shared(v)) {
+        lval_unshare(v);
+        for (int i = n; i < v->count; i++) lval_del(v->cell[i]);
+        if (v->buf) v->buf->end = v->buf->start + n;
+    }
+    v->count = n;
+}
+
 lval *lval_take(lval *v, int i) {
     lval *x = lval_pop(v, i);
     lval_del(v);
@@ -470,216 +1690,998 @@ lval *lval_take(lval *v, int i) {
 
 lval *lval_join(lval *x, lval *y) {
 
-    // for each cell in x add it to y
-    while (y->count) {
-        x = lval_add(x, lval_pop(y, 0));
+    x = lval_own(x);
+    if (y->count == 0) {
+        lval_del(y);
+        return x;
     }
 
+    // move every cell of y onto the end of x
+    y = lval_own(y);
+    lval_reserve(x, y->count);
+    lval_unshare(y);
+    memcpy(&x->cell[x->count], y->cell, sizeof(lval*) * y->count);
+    x->count += y->count;
+    if (x->buf) x->buf->end += y->count;
+    if (y->buf) y->buf->end = y->buf->start;
+    y->count = 0;
+
     lval_del(y);
     return x;
 }
 
 
-lval *builtin_op(lenv *e, lval *a, char *op) {
-    
-    // Ensure all numbers
-    for (int i = 0; i < a->count; i++) {
-        LASSERT_TYPE(op, a, i, LVAL_NUM);
+// Arithmetic builtins
+// Each operator is generated as its own builtin from these tables, with
+// no dispatch on the operator name at run time.
+//   X(name, symbol, nonzero if x op y fails or else sets r to it,
+//     1 if one argument x means 0 op x, error if it fails)
+#define LARITH_OPS(X) \
+    X(add, "+", __builtin_add_overflow(x, y, &r), 0, "Integer overflow!") \
+    X(sub, "-", __builtin_sub_overflow(x, y, &r), 1, "Integer overflow!") \
+    X(mul, "*", __builtin_mul_overflow(x, y, &r), 0, "Integer overflow!") \
+    X(div, "/", div_long(x, y, &r), 0, \
+            y == 0 ? "Division by zero!" : "Integer overflow!") \
+    X(pow, "^", pow_long(x, y, &r), 0, "Integer overflow!")
+
+// folds the numbers in the argument array left to right, their types
+// are checked by the descriptor
+#define LARITH_BUILTIN(name, sym, fails, negates, error) \
+lval *builtin_##name(lenv *e, lval *a) { \
+    lval **c = a->cell; \
+    long r; \
+    \
+    /* two numbers */ \
+    if (a->count == 2) { \
+        long x = c[0]->num; \
+        long y = c[1]->num; \
+        lval_del(a); \
+        if (fails) return lval_err(error); \
+        return lval_num(r); \
+    } \
+    \
+    LASSERT(a, a->count > 0, "Function '%s' passed no arguments.", sym); \
+    \
+    long x = c[0]->num; \
+    int i = 1; \
+    if (a->count == 1 && negates) { \
+        x = 0; \
+        i = 0; \
+    } \
+    for (; i < a->count; i++) { \
+        long y = c[i]->num; \
+        if (fails) { \
+            lval_del(a); \
+            return lval_err(error); \
+        } \
+        x = r; \
+    } \
+    lval_del(a); \
+    return lval_num(x); \
+}
+
+LARITH_OPS(LARITH_BUILTIN)
+
+// Comparison builtins
+//   X(name, symbol, result for numbers x and y)
+#define LORD_OPS(X) \
+    X(gt, ">", x > y) \
+    X(lt, "<", x < y) \
+    X(ge, ">=", x >= y) \
+    X(le, "<=", x <= y)
+
+#define LORD_BUILTIN(name, sym, result) \
+lval *builtin_##name(lenv *e, lval *a) { \
+    long x = a->cell[0]->num; \
+    long y = a->cell[1]->num; \
+    lval_del(a); \
+    return lval_bool(result); \
+}
+
+LORD_OPS(LORD_BUILTIN)
+
+// operators that quickened nodes compute inline, see lop_apply
+enum {
+    LOP_NONE,
+    #define X(name, ...) LOP_##name,
+    LARITH_OPS(X)
+    LORD_OPS(X)
+    #undef X
+};
+
+// Set *out to x op y and return 1, or return 0 if the builtin has to
+// report an error instead
+int lop_apply(int op, long x, long y, long *out) {
+    long r;
+    switch (op) {
+        #define X(name, sym, fails, ...) \
+            case LOP_##name: \
+                if (fails) return 0; \
+                *out = r; \
+                return 1;
+        LARITH_OPS(X)
+        #undef X
+        #define X(name, sym, result) \
+            case LOP_##name: \
+                *out = result; \
+                return 1;
+        LORD_OPS(X)
+        #undef X
     }
+    return 0;
+}
 
-    //first element
-    lval *x = lval_pop(a, 0);
+// number computed without an lval, 0 and 1 are the immortal booleans
+lval *lop_box(long x) {
+    return x == 0 || x == 1 ? lval_bool(x) : lval_num(x);
+}
 
-    // unary negation
-    if ((strcmp(op, "-") == 0) && a->count == 0) {
-        x->num = -x->num;
-    }
+//   X(name, symbol, result for values x and y)
+#define LCMP_OPS(X) \
+    X(eq, "==", lval_eq(x, y)) \
+    X(ne, "!=", !lval_eq(x, y))
 
-    while (a->count > 0) {
+#define LCMP_BUILTIN(name, sym, result) \
+lval *builtin_##name(lenv *e, lval *a) { \
+    LASSERT(a, !lval_has_seq(a->cell[0]) && !lval_has_seq(a->cell[1]), \
+            "Function '%s' cannot compare sequences.", sym); \
+    lval *x = a->cell[0]; \
+    lval *y = a->cell[1]; \
+    int r = result; \
+    lval_del(a); \
+    return lval_bool(r); \
+}
 
-        lval *y = lval_pop(a, 0);
+LCMP_OPS(LCMP_BUILTIN)
 
-        if (strcmp(op, "+") == 0) x->num += y->num;
-        if (strcmp(op, "-") == 0) x->num -= y->num;
-        if (strcmp(op, "*") == 0) x->num *= y->num;
-        if (strcmp(op, "/") == 0) {
-            if (y->num == 0) {
-                lval_del(x);
-                lval_del(y);
-                x = lval_err("Division by zero!");
-                break;
-            }
-        }
-        if (strcmp(op, "^") == 0) {
-            x->num = pow_long(x->num, y->num);
-        }
+lval *builtin_head(lenv *e, lval *a) {
+    // Error conditions
+    LASSERT_NOT_EMPTY("head", a, 0);
+    // list of the first element, which is shared rather than copied
+    lval *v = lval_add(lval_qexpr(), lval_retain(a->cell[0]->cell[0]));
+    lval_del(a);
+    return v;
+}
 
-        lval_del(y);
+lval *builtin_tail(lenv *e, lval *a) {
+    // Error conditions
+    LASSERT_NOT_EMPTY("tail", a, 0);
+
+    // Take first element
+    lval *v = lval_own(lval_take(a, 0));
+
+    // Delete it's first element
+    lval_del(lval_pop(v, 0));
+    return v;
+
+}
+
+lval *builtin_list(lenv *e, lval *a) {
+    lval_retype(a, LVAL_QEXPR);
+    return a;
+}
+
+lval *builtin_eval(lenv *e, lval *a) {
+    lval *x = lval_eval_body(e, a->cell[0]);
+    lval_del(a);
+    return x;
+}
+
+lval *builtin_join(lenv *e, lval *a) {
+    // Make sure all are Qexpr
+    for (int i = 0; i < a->count; i++) {
+        LASSERT_TYPE("joint", a, i, LVAL_QEXPR);
     }
 
+    lval *x = lval_own(lval_pop(a, 0));
+
+    while (a->count) {
+        x = lval_join(x, lval_pop(a, 0));
+    }
     lval_del(a);
     return x;
 }
 
-lval *builtin_ord(lenv *e, lval *a, char *op) {
-    LASSERT_NUM(op, a, 2);
-    LASSERT_TYPE(op, a, 0, LVAL_NUM);
-    LASSERT_TYPE(op, a, 1, LVAL_NUM);
-    
-    int r;
-    if (strcmp(op, ">") == 0) {
-        r = (a->cell[0]->num > a->cell[1]->num);
+// Call function value f with argument list a without consuming f
+lval *lval_call_value(lenv *e, lval *f, lval *a) {
+    if (f->type != LVAL_FUN) {
+        lval *err = lval_err("S-Expression starts with incorrect type. "
+        "Got %s, Expected %s.", ltype_name(f->type), ltype_name(LVAL_FUN));
+        lval_del(a);
+        return err;
     }
-    else if (strcmp(op, "<") == 0) {
-        r = (a->cell[0]->num < a->cell[1]->num);
+    return lval_call(e, f, a);
+}
+
+// Evaluate list item the same way as 'eval (head l)'
+lval *lval_eval_item(lenv *e, lval *x) {
+    return lval_eval_ref(e, x);
+}
+
+// Lazy sequences
+// range, iterate, lazy-map, lazy-filter and drop of a sequence only
+// record their arguments. Builtins taking a list also take a sequence
+// and walk it with an lcursor, which computes each element when it is
+// needed and lets go of it after, so walking a pipeline holds one
+// element per stage however many it produces. Elements are not kept
+// between walks, a sequence walked twice computes them twice.
+
+enum { LSEQ_RANGE, LSEQ_ITERATE, LSEQ_MAP, LSEQ_FILTER, LSEQ_DROP };
+
+lval *lval_seq(int kind, lval *gen, lval *src) {
+    lval *v = lval_alloc(LVAL_SEQ);
+    v->seq = kind;
+    v->from = 0;
+    v->to = 0;
+    v->gen = gen;
+    v->src = src;
+    return v;
+}
+
+// position in a sequence or Q-expression being walked
+typedef struct lcursor {
+    lval *seq; // borrowed from the caller
+    long i; // elements produced so far, or next number of a range
+    lval *x; // last element of an iterate
+    struct lcursor *src; // cursor over the elements mapped or filtered
+} lcursor;
+
+void lcursor_init(lcursor *c, lval *s) {
+    c->seq = s;
+    c->i = s->type == LVAL_SEQ && s->seq == LSEQ_RANGE ? s->from : 0;
+    c->x = NULL;
+    c->src = NULL;
+    if (s->type == LVAL_SEQ && s->seq != LSEQ_RANGE && s->seq != LSEQ_ITERATE) {
+        c->src = malloc(sizeof(lcursor));
+        lcursor_init(c->src, s->src);
     }
-    else if (strcmp(op, ">=") == 0) {
-        r = (a->cell[0]->num >= a->cell[1]->num);
+}
+
+void lcursor_end(lcursor *c) {
+    if (c->src) {
+        lcursor_end(c->src);
+        free(c->src);
     }
-    else if (strcmp(op, "<=") == 0) {
-        r = (a->cell[0]->num <= a->cell[1]->num);
+    if (c->x) lval_del(c->x);
+}
+
+// call f with the single argument x
+lval *lval_call_one(lenv *e, lval *f, lval *x) {
+    return lval_call_value(e, f, lval_add(lval_sexpr(), x));
+}
+
+// x if it is a number or an error, otherwise the error 'if' would
+// give for it as its condition
+lval *lval_cond(lval *x) {
+    if (x->type == LVAL_NUM || x->type == LVAL_ERR) return x;
+    lval *err = lval_err("Function '%s' passed incorrect type for "
+            "argument %i. Got %s, Expected %s.", "if", 0,
+            ltype_name(x->type), ltype_name(LVAL_NUM));
+    lval_del(x);
+    return err;
+}
+
+lval *lcursor_next(lenv *e, lcursor *c);
+
+// Walk past up to n elements of c, all of them if n is negative,
+// adding the number passed to *count. Returns an error met on the way.
+lval *lcursor_skip(lenv *e, lcursor *c, long n, long *count) {
+    for (; n != 0; n--) {
+        lval *x = lcursor_next(e, c);
+        if (!x || x->type == LVAL_ERR) return x;
+        lval_del(x);
+        (*count)++;
     }
-    lval_del(a);
-    return lval_num(r);
+    return NULL;
 }
 
-lval *builtin_cmp(lenv *e, lval *a, char *op) {
-    LASSERT_NUM(op, a, 2);
-    
-    int r;
-    if (strcmp(op, "==") == 0) {
-        r = lval_eq(a->cell[0], a->cell[1]);
+// Next element of c, or NULL after the last
+// An error is returned as the element and ends the walk.
+lval *lcursor_next(lenv *e, lcursor *c) {
+    lval *s = c->seq;
+    if (s->type == LVAL_QEXPR) {
+        if (c->i == s->count) return NULL;
+        return lval_eval_item(e, s->cell[c->i++]);
     }
-    else if (strcmp(op, "!=") == 0) {
-        r = !lval_eq(a->cell[0], a->cell[1]);
+
+    switch (s->seq) {
+        case LSEQ_RANGE:
+            if (c->i >= s->to) return NULL;
+            return lval_num(c->i++);
+
+        case LSEQ_ITERATE: {
+            lval *x = c->x ? lval_call_one(e, s->gen, lval_retain(c->x)) :
+                lval_retain(s->src);
+            if (x->type == LVAL_ERR) return x;
+            if (c->x) lval_del(c->x);
+            c->x = lval_retain(x);
+            return x;
+        }
+
+        case LSEQ_MAP: {
+            lval *x = lcursor_next(e, c->src);
+            if (!x || x->type == LVAL_ERR) return x;
+            return lval_call_one(e, s->gen, x);
+        }
+
+        case LSEQ_FILTER:
+            for (;;) {
+                lval *x = lcursor_next(e, c->src);
+                if (!x || x->type == LVAL_ERR) return x;
+                lval *keep = lval_cond(lval_call_one(e, s->gen,
+                            lval_retain(x)));
+                if (keep->type == LVAL_ERR) {
+                    lval_del(x);
+                    return keep;
+                }
+                int k = keep->num != 0;
+                lval_del(keep);
+                if (k) return x;
+                lval_del(x);
+            }
+
+        case LSEQ_DROP:
+            if (c->i < s->from) {
+                lval *err = lcursor_skip(e, c->src, s->from, &c->i);
+                c->i = s->from;
+                if (err) return err;
+            }
+            return lcursor_next(e, c->src);
     }
+    return NULL;
+}
+
+lval *builtin_range(lenv *e, lval *a) {
+    lval *v = lval_seq(LSEQ_RANGE, NULL, NULL);
+    v->from = a->cell[0]->num;
+    v->to = a->cell[1]->num;
     lval_del(a);
-    return lval_num(r);
+    return v;
 }
 
-lval *builtin_add(lenv *e, lval *a) {
-  return builtin_op(e, a, "+");
+lval *builtin_iterate(lenv *e, lval *a) {
+    lval *f = lval_pop(a, 0);
+    return lval_seq(LSEQ_ITERATE, f, lval_take(a, 0));
 }
 
-lval *builtin_sub(lenv *e, lval *a) {
-  return builtin_op(e, a, "-");
+lval *builtin_lazy_map(lenv *e, lval *a) {
+    LASSERT_LIST_AS("lazy-map", a, 1, 1);
+    lval *f = lval_pop(a, 0);
+    return lval_seq(LSEQ_MAP, f, lval_take(a, 0));
 }
 
-lval *builtin_mul(lenv *e, lval *a) {
-  return builtin_op(e, a, "*");
+lval *builtin_lazy_filter(lenv *e, lval *a) {
+    LASSERT_LIST_AS("lazy-filter", a, 1, 1);
+    lval *f = lval_pop(a, 0);
+    return lval_seq(LSEQ_FILTER, f, lval_take(a, 0));
 }
 
-lval *builtin_div(lenv *e, lval *a) {
-  return builtin_op(e, a, "/");
+// List library
+// These replace the recursive definitions that used to live in core.jlsp.
+// Failing calls report the same errors the recursive versions produced.
+
+lval *builtin_len(lenv *e, lval *a) {
+    LASSERT_LIST_AS("tail", a, 0, 0);
+
+    long n = a->cell[0]->count;
+    if (a->cell[0]->type == LVAL_SEQ) {
+        lcursor c;
+        lcursor_init(&c, a->cell[0]);
+        n = 0;
+        lval *err = lcursor_skip(e, &c, -1, &n);
+        lcursor_end(&c);
+        if (err) {
+            lval_del(a);
+            return err;
+        }
+    }
+    lval_del(a);
+    return lval_num(n);
+}
+
+// nth of a sequence, walking past the elements before it
+lval *lval_seq_nth(lenv *e, lval *a) {
+    long n = a->cell[0]->num;
+    LASSERT(a, n >= 0, "Funciton 'tail' passed {} for argument 0.");
+
+    lcursor c;
+    lcursor_init(&c, a->cell[1]);
+    long skipped = 0;
+    lval *x = lcursor_skip(e, &c, n, &skipped);
+    if (!x && skipped == n) x = lcursor_next(e, &c);
+    lcursor_end(&c);
+    if (!x) {
+        x = lval_err("Funciton '%s' passed {} for argument 0.",
+                skipped < n ? "tail" : "head");
+    }
+    lval_del(a);
+    return x;
 }
 
-lval *builtin_pow(lenv *e, lval *a) {
-    return builtin_op(e, a, "^");
+lval *builtin_nth(lenv *e, lval *a) {
+    LASSERT_TYPE("-", a, 0, LVAL_NUM);
+
+    long n = a->cell[0]->num;
+    lval *l = a->cell[1];
+    if (n == 0) LASSERT_LIST_AS("head", a, 1, 0);
+    LASSERT_LIST_AS("tail", a, 1, 0);
+    if (l->type == LVAL_SEQ) return lval_seq_nth(e, a);
+    LASSERT(a, n >= 0 && n <= l->count,
+            "Funciton 'tail' passed {} for argument 0.");
+    LASSERT(a, n < l->count,
+            "Funciton 'head' passed {} for argument 0.");
+
+    lval *x = lval_eval_item(e, l->cell[n]);
+    lval_del(a);
+    return x;
 }
 
-lval *builtin_gt(lenv *e, lval *a) {
-    return builtin_ord(e, a, ">");
+lval *builtin_last(lenv *e, lval *a) {
+    LASSERT_LIST_AS("tail", a, 0, 0);
+    lval *l = a->cell[0];
+
+    if (l->type == LVAL_SEQ) {
+        lcursor c;
+        lcursor_init(&c, l);
+        lval *x = NULL;
+        for (lval *y; (y = lcursor_next(e, &c)); ) {
+            if (x) lval_del(x);
+            x = y;
+            if (y->type == LVAL_ERR) break;
+        }
+        lcursor_end(&c);
+        lval_del(a);
+        return x ? x : lval_err("Funciton 'tail' passed {} for argument 0.");
+    }
+
+    LASSERT(a, l->count != 0,
+            "Funciton 'tail' passed {} for argument 0.");
+    lval *x = lval_eval_item(e, l->cell[l->count - 1]);
+    lval_del(a);
+    return x;
 }
 
-lval *builtin_lt(lenv *e, lval *a) {
-    return builtin_ord(e, a, "<");
+lval *builtin_map(lenv *e, lval *a) {
+    LASSERT_LIST_AS("head", a, 1, 0);
+
+    lval *f = a->cell[0];
+    lval *r = lval_qexpr();
+
+    lcursor c;
+    lcursor_init(&c, a->cell[1]);
+    for (lval *x; (x = lcursor_next(e, &c)); ) {
+        if (x->type != LVAL_ERR) x = lval_call_one(e, f, x);
+        if (x->type == LVAL_ERR) {
+            lval_del(r);
+            r = x;
+            break;
+        }
+        r = lval_add(r, x);
+    }
+    lcursor_end(&c);
+
+    lval_del(a);
+    return r;
 }
 
-lval *builtin_ge(lenv *e, lval *a) {
-    return builtin_ord(e, a, ">=");
+lval *builtin_filter(lenv *e, lval *a) {
+    LASSERT_LIST_AS("head", a, 1, 0);
+
+    lval *f = a->cell[0];
+    lval *l = a->cell[1];
+    lval *r = lval_qexpr();
+
+    lcursor c;
+    lcursor_init(&c, l);
+    for (lval *y; (y = lcursor_next(e, &c)); ) {
+        lval *x = y;
+        if (y->type != LVAL_ERR) {
+            x = lval_cond(lval_call_one(e, f, lval_retain(y)));
+        }
+        if (x->type == LVAL_ERR) {
+            if (x != y) lval_del(y);
+            lval_del(r);
+            r = x;
+            break;
+        }
+        // keep the original unevaluated item of a list
+        if (x->num) {
+            r = lval_add(r, l->type == LVAL_QEXPR ?
+                    lval_retain(l->cell[c.i - 1]) : lval_retain(y));
+        }
+        lval_del(x);
+        lval_del(y);
+    }
+    lcursor_end(&c);
+
+    lval_del(a);
+    return r;
 }
 
-lval *builtin_le(lenv *e, lval *a) {
-    return builtin_ord(e, a, "<=");
+// The first n elements of a sequence, or all of them if it has fewer
+lval *lval_seq_take(lenv *e, lval *a) {
+    long n = a->cell[0]->num;
+    LASSERT(a, n >= 0, "Funciton 'head' passed {} for argument 0.");
+
+    lval *r = lval_qexpr();
+    lcursor c;
+    lcursor_init(&c, a->cell[1]);
+    for (lval *x; n-- > 0 && (x = lcursor_next(e, &c)); ) {
+        if (x->type == LVAL_ERR) {
+            lval_del(r);
+            r = x;
+            break;
+        }
+        r = lval_add(r, x);
+    }
+    lcursor_end(&c);
+
+    lval_del(a);
+    return r;
 }
 
-lval *builtin_eq(lenv *e, lval *a) {
-    return builtin_cmp(e, a, "==");
+lval *builtin_take(lenv *e, lval *a) {
+    LASSERT_TYPE("-", a, 0, LVAL_NUM);
+    LASSERT_LIST_AS("head", a, 1, 0);
+
+    long n = a->cell[0]->num;
+    lval *l = a->cell[1];
+    if (l->type == LVAL_SEQ) return lval_seq_take(e, a);
+    LASSERT(a, n >= 0 && n <= l->count,
+            "Funciton 'head' passed {} for argument 0.");
+
+    // drop everything after the first n items
+    lval *r = lval_own(lval_pop(a, 1));
+    lval_truncate(r, n);
+    lval_del(a);
+    return r;
 }
 
-lval *builtin_ne(lenv *e, lval *a) {
-    return builtin_cmp(e, a, "!=");
+lval *builtin_drop(lenv *e, lval *a) {
+    LASSERT_TYPE("-", a, 0, LVAL_NUM);
+    LASSERT_LIST_AS("tail", a, 1, 0);
+
+    long n = a->cell[0]->num;
+    lval *l = a->cell[1];
+    if (l->type == LVAL_SEQ) {
+        // dropped lazily, a sequence shorter than n ends up empty
+        LASSERT(a, n >= 0, "Funciton 'tail' passed {} for argument 0.");
+        lval *v = lval_seq(LSEQ_DROP, NULL, lval_pop(a, 1));
+        v->from = n;
+        lval_del(a);
+        return v;
+    }
+    LASSERT(a, n >= 0 && n <= l->count,
+            "Funciton 'tail' passed {} for argument 0.");
+
+    // popping from the front is constant time
+    lval *r = lval_own(lval_pop(a, 1));
+    for (long i = 0; i < n; i++) lval_del(lval_pop(r, 0));
+    lval_del(a);
+    return r;
 }
 
-lval *builtin_head(lenv *e, lval *a) {
-    // Error conditions
-    LASSERT_NUM("head", a, 1);
-    LASSERT_TYPE("head", a, 0, LVAL_QEXPR);
-    LASSERT_NOT_EMPTY("head", a, 0);
-    // Take first element
-    lval *v = lval_take(a, 0);
-    // Delete all elements that are not head
-    while (v->count > 1) lval_del(lval_pop(v, 1));
-    return v;
+lval *builtin_elem(lenv *e, lval *a) {
+    LASSERT_LIST_AS("head", a, 1, 0);
+    LASSERT(a, !lval_has_seq(a->cell[0]),
+            "Function 'elem' cannot compare sequences.");
+
+    lval *r = lval_bool(false);
+    lcursor c;
+    lcursor_init(&c, a->cell[1]);
+    for (lval *x; (x = lcursor_next(e, &c)); ) {
+        if (x->type == LVAL_ERR) {
+            r = x;
+            break;
+        }
+        int found = lval_eq(a->cell[0], x);
+        lval_del(x);
+        if (found) {
+            r = lval_bool(true);
+            break;
+        }
+    }
+    lcursor_end(&c);
+
+    lval_del(a);
+    return r;
 }
 
-lval *builtin_tail(lenv *e, lval *a) {
-    // Error conditions
-    LASSERT_NUM("tail", a, 1);
-    LASSERT_TYPE("tail", a, 0, LVAL_QEXPR);
-    LASSERT_NOT_EMPTY("tail", a, 0);
+// Fold state
+// A fold ends early once a transducer step sets lreduced, see lval_reduce.
 
-    // Take first element
-    lval *v = lval_take(a, 0);
+static __thread int lreduced;
 
-    // Delete it's first element
-    lval_del(lval_pop(v, 0));
-    return v;
+// Taking steps count down in the fold they run in, not in the step, so
+// a reducing function can be shared and used for several folds. Only
+// steps the fold reaches through lval_reduce count in it; a step called
+// any other way, say from a lambda in the fold, is a fold of its own.
+typedef struct ltaking {
+    lval *n; // count the step was made with
+    long left;
+} ltaking;
 
+static __thread struct {
+    ltaking *steps;
+    int count;
+    int capacity;
+    int base; // first step of the innermost fold
+} ltakings;
+
+typedef struct lfold {
+    int base;
+    int reduced;
+} lfold;
+
+// Start a fold with counts of its own, returning the state of the one
+// it runs in, so that a fold inside a step keeps the outer one going
+lfold lfold_begin() {
+    lfold outer = { ltakings.base, lreduced };
+    ltakings.base = ltakings.count;
+    lreduced = 0;
+    return outer;
+}
+
+void lfold_end(lfold outer) {
+    for (int i = ltakings.base; i < ltakings.count; i++) {
+        lval_del(ltakings.steps[i].n);
+    }
+    ltakings.count = ltakings.base;
+    ltakings.base = outer.base;
+    lreduced = outer.reduced;
 }
 
-lval *builtin_list(lenv *e, lval *a) {
-    a->type = LVAL_QEXPR;
-    return a;
-}
+lval *lval_reduce(lenv *e, lval *rf, lval *z, lval *x);
 
-lval *builtin_eval(lenv *e, lval *a) {
-    LASSERT_NUM("eval", a, 1);
-    LASSERT_TYPE("eval", a, 0, LVAL_QEXPR);
+// Count of the taking step made with n in the innermost fold
+long *ltaking_left(lval *n) {
+    for (int i = ltakings.count - 1; i >= ltakings.base; i--) {
+        if (ltakings.steps[i].n == n) return &ltakings.steps[i].left;
+    }
+    if (ltakings.count == ltakings.capacity) {
+        ltakings.capacity = ltakings.capacity ? ltakings.capacity * 2 : 8;
+        ltakings.steps = realloc(ltakings.steps,
+                sizeof(ltaking) * ltakings.capacity);
+    }
+    // held so that no other step is made at the same address meanwhile
+    ltaking *t = &ltakings.steps[ltakings.count++];
+    t->n = lval_retain(n);
+    t->left = n->num;
+    return &t->left;
+}
+
+lval *builtin_foldl(lenv *e, lval *a) {
+    LASSERT_LIST_AS("head", a, 2, 0);
+
+    lval *f = a->cell[0];
+    lval *z = lval_pop(a, 1);
+
+    lfold outer = lfold_begin();
+    lcursor c;
+    lcursor_init(&c, a->cell[1]);
+    for (lval *x; (x = lcursor_next(e, &c)); ) {
+        if (x->type == LVAL_ERR) {
+            lval_del(z);
+            z = x;
+            break;
+        }
+        z = lval_reduce(e, f, z, x);
+        if (z->type == LVAL_ERR) break;
+    }
+    lcursor_end(&c);
+    lfold_end(outer);
 
-    lval *x = lval_take(a, 0);
-    x->type = LVAL_SEXPR;
+    lval_del(a);
+    return z;
+}
+
+// foldl with a builtin operator over numbers
+//   X(name, symbol, initial z, z op x)
+#define LFOLD_OPS(X) \
+    X(sum, "+", 0, z + x) \
+    X(product, "*", 1, z * x)
+
+#define LFOLD_BUILTIN(name, sym, init, step) \
+lval *builtin_##name(lenv *e, lval *a) { \
+    LASSERT_LIST_AS("head", a, 0, 0); \
+    \
+    long z = init; \
+    lval *err = NULL; \
+    lcursor c; \
+    lcursor_init(&c, a->cell[0]); \
+    for (lval *v; (v = lcursor_next(e, &c)); ) { \
+        if (v->type != LVAL_NUM) { \
+            err = v; \
+            if (v->type != LVAL_ERR) { \
+                err = lval_err("Function '%s' passed incorrect type for " \
+                        "argument %i. Got %s, Expected %s.", sym, 1, \
+                        ltype_name(v->type), ltype_name(LVAL_NUM)); \
+                lval_del(v); \
+            } \
+            break; \
+        } \
+        long x = v->num; \
+        z = step; \
+        lval_del(v); \
+    } \
+    lcursor_end(&c); \
+    \
+    lval_del(a); \
+    return err ? err : lval_num(z); \
+}
+
+LFOLD_OPS(LFOLD_BUILTIN)
+
+lval *builtin_unpack(lenv *e, lval *a) {
+    LASSERT_TYPE("joint", a, 1, LVAL_QEXPR);
+
+    // eval (join (list f) l)
+    lval *f = lval_pop(a, 0);
+    lval *x = lval_join(lval_add(lval_sexpr(), f), lval_take(a, 0));
     return lval_eval(e, x);
 }
 
-lval *builtin_join(lenv *e, lval *a) {
-    // Make sure all are Qexpr
-    for (int i = 0; i < a->count; i++) {
-        LASSERT_TYPE("joint", a, i, LVAL_QEXPR);
+lval *builtin_pack(lenv *e, lval *a) {
+    LASSERT(a, a->count > 0, "Function 'pack' passed no function.");
+
+    lval *f = lval_pop(a, 0);
+    lval_retype(a, LVAL_QEXPR);
+    lval *x = lval_call_value(e, f, lval_add(lval_sexpr(), a));
+    lval_del(f);
+    return x;
+}
+
+// Transducers
+// (mapping f), (filtering p) and (taking n) are transducers: functions
+// from a reducing function rf to another one that hands rf what is left
+// of each element. They are partial applications of curried builtins,
+// so comp composes them like any other function. transduce folds a list
+// or sequence with the reducing function made, one element at a time
+// with no lists between the steps. A step ends the fold early by setting
+// lreduced.
+
+lval *builtin_mapping(lenv *e, lval *a);
+lval *builtin_filtering(lenv *e, lval *a);
+lval *builtin_taking_step(lenv *e, lval *a);
+
+// 1 if a taking step made with count n passes on one more element
+int ltaking_pass(lval *n) {
+    long *left = ltaking_left(n);
+    if (*left <= 0) {
+        lreduced = 1;
+        return 0;
     }
+    if (--*left == 0) lreduced = 1;
+    return 1;
+}
+
+// Reduce z and x with rf
+// The steps of mapping, filtering and taking run here one after the
+// other, calling only the functions they were given and the reducing
+// function at the end.
+lval *lval_reduce(lenv *e, lval *rf, lval *z, lval *x) {
+    while (rf->type == LVAL_FUN && rf->builtin && rf->bound &&
+            rf->bound->count == 2) {
+        lval *f = rf->bound->cell[0];
+
+        if (rf->builtin == builtin_mapping) {
+            x = lval_call_one(e, f, x);
+        } else if (rf->builtin == builtin_filtering) {
+            lval *keep = lval_cond(lval_call_one(e, f, lval_retain(x)));
+            if (keep->type == LVAL_ERR) {
+                lval_del(x);
+                x = keep;
+            } else {
+                int k = keep->num != 0;
+                lval_del(keep);
+                if (!k) {
+                    lval_del(x);
+                    return z;
+                }
+            }
+        } else if (rf->builtin == builtin_taking_step) {
+            if (!ltaking_pass(f)) {
+                lval_del(x);
+                return z;
+            }
+        } else {
+            break;
+        }
 
-    lval *x = lval_pop(a, 0);
+        if (x->type == LVAL_ERR) {
+            lval_del(z);
+            return x;
+        }
+        rf = rf->bound->cell[1];
+    }
+    return lval_call_value(e, rf, lval_add(lval_add(lval_sexpr(), z), x));
+}
 
-    while (a->count) {
-        x = lval_join(x, lval_pop(a, 0));
+// (mapping f rf z x) is rf z (f x)
+// Called directly, each of the steps is a fold of its own.
+lval *builtin_mapping(lenv *e, lval *a) {
+    lval *x = lval_call_one(e, a->cell[0], lval_pop(a, 3));
+    if (x->type == LVAL_ERR) {
+        lval_del(a);
+        return x;
+    }
+    lfold outer = lfold_begin();
+    lval *z = lval_reduce(e, a->cell[1], lval_pop(a, 2), x);
+    lfold_end(outer);
+    lval_del(a);
+    return z;
+}
+
+// (filtering p rf z x) is rf z x if p x holds, otherwise z
+lval *builtin_filtering(lenv *e, lval *a) {
+    lval *keep = lval_cond(lval_call_one(e, a->cell[0],
+                lval_retain(a->cell[3])));
+    if (keep->type == LVAL_ERR) {
+        lval_del(a);
+        return keep;
+    }
+    int k = keep->num != 0;
+    lval_del(keep);
+
+    lval *x = lval_pop(a, 3);
+    lval *z = lval_pop(a, 2);
+    if (k) {
+        lfold outer = lfold_begin();
+        z = lval_reduce(e, a->cell[1], z, x);
+        lfold_end(outer);
+    } else {
+        lval_del(x);
+    }
+    lval_del(a);
+    return z;
+}
+
+// (taking-step n rf z x) is rf z x for the first n elements of the fold
+lval *builtin_taking_step(lenv *e, lval *a) {
+    lval *x = lval_pop(a, 3);
+    lval *z = lval_pop(a, 2);
+    lfold outer = lfold_begin();
+    if (ltaking_pass(a->cell[0])) {
+        z = lval_reduce(e, a->cell[1], z, x);
+    } else {
+        lval_del(x);
+    }
+    lfold_end(outer);
+    lval_del(a);
+    return z;
+}
+
+static const ldesc ltaking_step = { "taking", builtin_taking_step, 4,
+    LDESC_CURRIED, { LVAL_NUM, LTYPE_ANY, LTYPE_ANY } };
+
+// (taking n rf) is a step ending the fold after n elements, made with
+// a count of its own so that it is told apart from other steps
+lval *builtin_taking(lenv *e, lval *a) {
+    lval *step = lval_fun(builtin_taking_step);
+    step->desc = &ltaking_step;
+    lval *n = lval_num(a->cell[0]->num);
+    step->bound = lval_add(lval_add(lval_sexpr(), n), lval_pop(a, 1));
+    lval_del(a);
+    return step;
+}
+
+// (transduce xf rf z l) folds l from z with the reducing function xf
+// makes of rf
+lval *builtin_transduce(lenv *e, lval *a) {
+    LASSERT_LIST_AS("transduce", a, 3, 3);
+
+    lval *rf = lval_call_one(e, a->cell[0], lval_retain(a->cell[1]));
+    if (rf->type == LVAL_ERR) {
+        lval_del(a);
+        return rf;
+    }
+    lval *z = lval_pop(a, 2);
+
+    lfold outer = lfold_begin();
+    lcursor c;
+    lcursor_init(&c, a->cell[2]);
+    for (lval *x; !lreduced && (x = lcursor_next(e, &c)); ) {
+        if (x->type == LVAL_ERR) {
+            lval_del(z);
+            z = x;
+            break;
+        }
+        z = lval_reduce(e, rf, z, x);
+        if (z->type == LVAL_ERR) break;
+    }
+    lcursor_end(&c);
+    lfold_end(outer);
+
+    lval_del(rf);
+    lval_del(a);
+    return z;
+}
+
+lval *builtin_if(lenv *e, lval *a) {
+    // args of the form (num) {Qexpr} {Qexpr}
+
+    // evaluate the chosen branch without copying it
+    lval *x;
+    if (a->cell[0]->num) {
+    // true
+        x = lval_eval_body(e, a->cell[1]);
+    } else {
+    // false
+        x = lval_eval_body(e, a->cell[2]);
+    }
+
+    lval_del(a);
+    return x;
+
+}
+
+lval *builtin_while(lenv *e, lval *a) {
+    // args of the form {condition} {body}
+
+    lval *cond = a->cell[0];
+    lval *body = a->cell[1];
+
+    while (true) {
+        lval *c = lval_eval_body(e, cond);
+        if (c->type == LVAL_ERR) {
+            lval_del(a);
+            return c;
+        }
+        if (c->type != LVAL_NUM) {
+            lval *err = lval_err("Function 'while' condition evaluated to "
+                    "incorrect type. Got %s, Expected %s.",
+                    ltype_name(c->type), ltype_name(LVAL_NUM));
+            lval_del(c);
+            lval_del(a);
+            return err;
+        }
+        int done = !c->num;
+        lval_del(c);
+        if (done) break;
+
+        // body result is only kept if it is an error
+        lval *x = lval_eval_body(e, body);
+        if (x->type == LVAL_ERR) {
+            lval_del(a);
+            return x;
+        }
+        lval_del(x);
     }
+
     lval_del(a);
-    return x;
+    return lval_sexpr();
 }
 
-lval *builtin_if(lenv *e, lval *a) {
-    // args of the form (num) {Qexpr} {Qexpr}
-    LASSERT_NUM("if", a, 3);
-    LASSERT_TYPE("if", a, 0, LVAL_NUM);
-    LASSERT_TYPE("if", a, 1, LVAL_QEXPR);
-    LASSERT_TYPE("if", a, 2, LVAL_QEXPR);
+lval *builtin_dotimes(lenv *e, lval *a) {
+    // args of the form {sym} (num) {body}
+    LASSERT(a, a->cell[0]->count == 1 && a->cell[0]->cell[0]->type == LVAL_SYM,
+            "Function 'dotimes' expects a single counter symbol.");
 
-    // make both expression evaluateable
-    lval *x;
-    a->cell[1]->type = LVAL_SEXPR;
-    a->cell[2]->type = LVAL_SEXPR;
-    
-    if (a->cell[0]->num) {
-    // true
-        x = lval_eval(e, lval_pop(a, 1));
-    } else {
-    // false
-        x = lval_eval(e, lval_pop(a, 2));
+    lval *sym = a->cell[0]->cell[0];
+    lval *body = a->cell[2];
+    long n = a->cell[1]->num;
+
+    // counter lives in a scope of its own, rebound every iteration, so
+    // the caller's bindings are left alone; '=' in the body still binds
+    // in the caller, except on the counter, see builtin_var
+    lenv *env = lenv_new();
+    env->flags |= LALLOC_LOOP;
+    env->parent = e;
+    for (long i = 0; i < n; i++) {
+        lenv_put_move(env, sym, lval_num(i));
+
+        lval *x = lval_eval_body(env, body);
+        if (x->type == LVAL_ERR) {
+            lenv_del(env);
+            lval_del(a);
+            return x;
+        }
+        lval_del(x);
     }
 
+    lenv_del(env);
     lval_del(a);
-    return x;
-
+    return lval_sexpr();
 }
 
 lval *builtin_var(lenv *e, lval *a, char *func) {
@@ -701,16 +2703,20 @@ lval *builtin_var(lenv *e, lval *a, char *func) {
             "Function '%s' passed too many arguments for symbols. "
             "Got %i, Expected %i.", func, syms->count, a->count-1);
 
-    // assign copies of value to symbols
+    // 'def' in global 'put' in local
+    lenv *t = e;
+    if (strcmp(func, "def") == 0) {
+        while (t->parent) t = t->parent;
+    }
+
+    // symbols share the argument values
     for (int i = 0; i < syms->count; i++) {
-        // 'def' in global 'put' in local
-        if (strcmp(func, "def") == 0) {
-            lenv_def(e, syms->cell[i], a->cell[i + 1]);
+        // past loop counter scopes, unless it is their counter
+        lenv *s = t;
+        while (s->flags & LALLOC_LOOP && !lenv_binds(s, syms->cell[i]->sym)) {
+            s = s->parent;
         }
-        if (strcmp(func, "=") == 0) {
-            lenv_put(e, syms->cell[i], a->cell[i + 1]);
-        }
-
+        lenv_put_move(s, syms->cell[i], lval_retain(a->cell[i + 1]));
     }
 
     lval_del(a);
@@ -726,11 +2732,6 @@ lval *builtin_put(lenv *e, lval *a) {
 }
 
 lval *builtin_lambda(lenv *e, lval *a) {
-    // Check two arguments, each are Q-expr
-    LASSERT_NUM("\\", a, 2);
-    LASSERT_TYPE("\\", a, 0, LVAL_QEXPR);
-    LASSERT_TYPE("\\", a, 1, LVAL_QEXPR);
-
     // check that first Q-expression only contains symbols
     for (int i = 0; i < a->cell[0]->count; i++) {
         LASSERT(a, (a->cell[0]->cell[i]->type == LVAL_SYM),
@@ -748,15 +2749,26 @@ lval *builtin_lambda(lenv *e, lval *a) {
 }
 
 lval *builtin_error(lenv *e, lval *a) {
-    LASSERT_NUM("error", a, 1);
-    LASSERT_TYPE("error", a, 0, LVAL_STR);
-
-    lval *err = lval_err(a->cell[0]->str);
+    lval *err = lval_err("%s", a->cell[0]->str);
 
     lval_del(a);
     return err;
 }
 
+// (try {body} handler) calls handler with the message of any error
+// the body evaluates to
+lval *builtin_try(lenv *e, lval *a) {
+    lval *x = lval_eval_body(e, a->cell[0]);
+    if (x->type == LVAL_ERR) {
+        lval *msg = lval_str(lval_err_text(x));
+        lval_del(x);
+        x = lval_call_value(e, a->cell[1], lval_add(lval_sexpr(), msg));
+    }
+
+    lval_del(a);
+    return x;
+}
+
 lval *builtin_print(lenv *e, lval *a) {
 
     for (int i = 0; i < a->count; i++) {
@@ -770,25 +2782,66 @@ lval *builtin_print(lenv *e, lval *a) {
     return lval_sexpr();
 }
 
-lval *builtin_load(lenv *e, lval *a) {
-    LASSERT_NUM("load", a, 1);
-    LASSERT_TYPE("load", a, 0, LVAL_STR);
+lval *builtin_alloc_stats(lenv *e, lval *a) {
+    // counters for a type name, "Environment" or "Array"
+    char *name = a->cell[0]->str;
+    lstat *s = NULL;
+    for (int t = 0; t <= LVAL_SEQ; t++) {
+        if (strcmp(name, ltype_name(t)) == 0) s = &lval_stats[t];
+    }
+    if (strcmp(name, "Environment") == 0) s = &lenv_stats;
+    if (strcmp(name, "Array") == 0) s = &lmem_stats;
+    LASSERT(a, s, "Function 'alloc-stats' passed unknown type '%s'.", name);
 
+    lstat counts = *s;
+    lval_del(a);
+
+    lval *x = lval_qexpr();
+    x = lval_add(x, lval_num(counts.live));
+    x = lval_add(x, lval_num(counts.peak));
+    x = lval_add(x, lval_num(counts.total));
+    return x;
+}
+
+lval *builtin_quicken_stats(lenv *e, lval *a) {
+    // counters for "Symbol", "Call", "Operator", "Inline" or "Fusion" nodes
+    char *name = a->cell[0]->str;
+    lqstat *s = NULL;
+    if (strcmp(name, "Symbol") == 0) s = &lquick_sym;
+    if (strcmp(name, "Call") == 0) s = &lquick_call;
+    if (strcmp(name, "Operator") == 0) s = &lquick_op;
+    if (strcmp(name, "Inline") == 0) s = &lquick_inline;
+    if (strcmp(name, "Fusion") == 0) s = &lquick_fuse;
+    LASSERT(a, s, "Function 'quicken-stats' passed unknown kind '%s'.", name);
+
+    lqstat counts = *s;
+    lval_del(a);
+
+    lval *x = lval_qexpr();
+    x = lval_add(x, lval_num(counts.rewritten));
+    x = lval_add(x, lval_num(counts.hits));
+    x = lval_add(x, lval_num(counts.fallbacks));
+    return x;
+}
+
+lval *builtin_load(lenv *e, lval *a) {
     mpc_result_t r;
     if (mpc_parse_contents(a->cell[0]->str, lispy, &r)) {
-        // read contents
-        lval *expr = lval_read(r.output);
-        mpc_ast_delete(r.output);
+        mpc_ast_t *t = r.output;
+
+        // read and eval each expression in a region of its own
+        for (int i = 0; i < t->children_num; i++) {
+            if (lval_read_skip(t->children[i])) continue;
 
-        // eval each expression
-        while (expr->count) {
-            lval *x = lval_eval(e, lval_pop(expr, 0));
+            int opened = lregion_begin();
+            lval *x = lval_eval(e, lval_read(t->children[i]));
             // if error print it
             if (x->type == LVAL_ERR) lval_println(x);
             lval_del(x);
+            if (opened) lregion_end();
         }
 
-        lval_del(expr);
+        mpc_ast_delete(r.output);
         lval_del(a);
 
         // return empty list
@@ -807,12 +2860,682 @@ lval *builtin_load(lenv *e, lval *a) {
 
 }
 
+// Code arenas
+// An interned list is flattened the first time lval_eval_body runs it.
+// Its whole tree is laid out in one array of lnode, the children of a
+// list next to each other at a 32 bit offset from it, and evaluation
+// walks that array instead of chasing lval and cell pointers. Every
+// list in the tree points at its node, so a block evaluated later by a
+// builtin, like the branches of an if, runs from the same arena.
+//
+// An arena is never freed, like the interned value it is built from,
+// and goes away with the process. It costs one lnode per value in the
+// tree, once per distinct literal that is evaluated, as equal literals
+// are one interned value, see lval_intern: a program
+// holds about as many nodes as its source has values, and a REPL session
+// grows by the forms typed into it. The inlined copy of a lambda body
+// made by lnode_inline is the exception, freed once it is undone.
+
+// node for a formal of an inlined lambda, standing for its argument
+#define LNODE_ARG (LVAL_SEQ + 1)
+
+// LNODE_SCRATCH marks S-expressions whose argument list never escapes
+// the builtin they call, so it is built with lval_scratch, LNODE_FUSED
+// list builtins called on the result of map or filter, see lnode_fuse,
+// and LNODE_CHECKED calls given as many arguments as the builtin takes,
+// whose types are then checked as they are evaluated
+enum { LNODE_SCRATCH = 1, LNODE_FUSED = 2, LNODE_CHECKED = 4 };
+
+struct lnode {
+    short type; // of the value the node was built from, or LNODE_ARG
+    short flags;
+    int count; // children of a list
+    int child; // offset from the node to its first child
+
+    // S-expression: linline_epoch its inlined body was built in,
+    // LINLINE_NEVER once it has given up inlining
+    int epoch;
+
+    union {
+        long num;
+
+        // Symbol: see lenv_get_cached, and the argument of LNODE_ARG
+        struct {
+            int depth;
+            int slot;
+        };
+
+        // S-expression: builtin it calls once quickened, or the lambda
+        // it has inlined
+        lval *op;
+    };
+    union {
+        lval *val; // result of a literal
+        char *sym;
+        lnode *body; // arena of the inlined lambda
+    };
+};
+
+// nodes needed for v and everything in it
+int lcode_size(lval *v) {
+    int n = 1;
+    if (v->type == LVAL_SEXPR || v->type == LVAL_QEXPR) {
+        for (int i = 0; i < v->count; i++) n += lcode_size(v->cell[i]);
+    }
+    return n;
+}
+
+// Fill nodes[i] from v, laying out the children of lists from *next
+// With formals, the arena is an inlined copy of a lambda body: its
+// formals become LNODE_ARG and its lists keep pointing at their own
+// arenas.
+void lcode_fill(lnode *nodes, int i, lval *v, int *next, lval *formals) {
+    lnode *n = &nodes[i];
+    n->type = v->type;
+    n->flags = 0;
+    n->count = 0;
+    n->child = 0;
+    n->epoch = 0;
+    n->op = NULL;
+    n->val = v;
+
+    switch (v->type) {
+        case LVAL_NUM:
+            n->num = v->num;
+            break;
+        case LVAL_SYM:
+            n->depth = LSLOT_NONE;
+            n->slot = 0;
+            n->sym = v->sym;
+            for (int j = 0; formals && j < formals->count; j++) {
+                if (strcmp(formals->cell[j]->sym, v->sym) != 0) continue;
+                n->type = LNODE_ARG;
+                n->slot = j;
+            }
+            break;
+        case LVAL_SEXPR:
+        case LVAL_QEXPR: {
+            int first = *next;
+            *next += v->count;
+            n->count = v->count;
+            n->child = first - i;
+
+            // a list shared by several trees runs from the first arena
+            if (!v->code && !formals) v->code = n;
+            for (int j = 0; j < v->count; j++) {
+                lcode_fill(nodes, first + j, v->cell[j], next, formals);
+            }
+            break;
+        }
+    }
+}
+
+// Arena for v, NULL if there is no memory for one
+lnode *lcode_new(lval *v, lval *formals) {
+    int size = lcode_size(v);
+    lnode *nodes = malloc(sizeof(lnode) * size);
+    if (!nodes) return NULL;
+
+    int next = 1;
+    lcode_fill(nodes, 0, v, &next, formals);
+    return nodes;
+}
+
+// Flatten interned list v into an arena of its own, leaving it to the
+// general path if there is no memory for one
+void lcode_build(lval *v) {
+    lcode_new(v, NULL);
+}
+
+// Quickening
+// An S-expression node calling a builtin remembers the builtin in op
+// the first time it is evaluated, and is then run by lnode_eval_quick:
+// the builtin is called directly, its argument count checked once when
+// quickened and their types as they are evaluated, and an operator on
+// two numbers is computed without building an argument list. Symbol
+// nodes likewise remember where their binding was found, see
+// lenv_get_cached. Every rewrite is guarded, a node whose head no longer
+// names its builtin is rewritten back, and an operator given anything
+// but numbers calls the builtin.
+//
+// Evaluation inside an inlined body is given the arguments of the
+// inlined call, and returns NULL when it reaches anything that is not a
+// pure builtin, see lnode_inline.
+
+lval *lnode_eval(lenv *e, lnode *n, lval **args);
+lval *lnode_eval_inline(lenv *e, lnode *n);
+int lnode_inline(lenv *e, lnode *n, lval *f);
+void lnode_fuse(lenv *e, lnode *n, lval *f);
+lval *lnode_eval_fused(lenv *e, lnode *n, lval *f);
+
+int lval_is_pure(lval *f) {
+    return f->builtin && f->desc && (f->desc->flags & LDESC_PURE);
+}
+
+// Remember function f, the value of the head of n, if n can call it
+// directly
+void lnode_quicken(lenv *e, lnode *n, lval *f, lval **args) {
+    if (n->count < 2 || n[n->child].type != LVAL_SYM) return;
+    if (f->type != LVAL_FUN) return;
+    if (!f->builtin) {
+        if (!args) lnode_inline(e, n, f);
+        return;
+    }
+    if (!lval_is_immortal(f) || !f->desc) return;
+
+    // escape analysis: the argument list outlives the call if the
+    // builtin keeps it, or a curried one is partially applied
+    const ldesc *d = f->desc;
+    n->flags &= ~(LNODE_SCRATCH | LNODE_FUSED | LNODE_CHECKED);
+    if (!(d->flags & LDESC_KEEPS_ARGS) &&
+            (!(d->flags & LDESC_CURRIED) || n->count - 1 >= d->arity)) {
+        n->flags |= LNODE_SCRATCH;
+    }
+    if (d->arity < 0 || n->count - 1 == d->arity) n->flags |= LNODE_CHECKED;
+    lnode_fuse(e, n, f);
+
+    n->op = f;
+    lquick_call.rewritten++;
+    if (f->desc->op && n->count == 3) lquick_op.rewritten++;
+}
+
+// Builtin n is quickened to, NULL if its head no longer names it,
+// rewriting n back
+lval *lnode_guard(lenv *e, lnode *n) {
+    lnode *c = n + n->child;
+    lval *f = lenv_get_cached(e, c[0].sym, &c[0].depth, &c[0].slot);
+    if (f != n->op) {
+        n->op = NULL;
+        lquick_call.fallbacks++;
+        return NULL;
+    }
+    lquick_call.hits++;
+    return f;
+}
+
+// 1 if n is quickened to an operator on two numbers
+int lnode_is_op(lnode *n) {
+    return n->op && n->epoch <= 0 && n->op->desc->op && n->count == 3;
+}
+
+int lnode_eval_op(lenv *e, lnode *n, lval *f, lval **args, long *r,
+        lval **v);
+
+// Unboxed numbers
+// The result of an operator node is known to be a number once it is
+// quickened, and so is a literal. An operator node takes the value of
+// such a child, or of a variable holding a number, as a C long, so a
+// nested expression like (+ (* x x) (* y y)) allocates only its final
+// result, which is boxed where it escapes into a list, a binding or a
+// call. Anything else is evaluated as usual and unboxed if it turns out
+// to be a number.
+
+// Evaluate n for an operator, returning 1 with a number in *x, or 0
+// with any other value in *v
+int lnode_eval_num(lenv *e, lnode *n, lval **args, long *x, lval **v) {
+    lval *b;
+    switch (n->type) {
+        case LVAL_NUM:
+            *x = n->num;
+            return 1;
+        case LNODE_ARG:
+            b = args[n->slot];
+            break;
+        case LVAL_SYM:
+            b = lenv_get_cached(e, n->sym, &n->depth, &n->slot);
+            if (!b) {
+                *v = lval_err("Unbound symbol '%s'", n->sym);
+                return 0;
+            }
+            break;
+        default:
+            if (lnode_is_op(n)) {
+                lval *f = lnode_guard(e, n);
+                if (f) return lnode_eval_op(e, n, f, args, x, v);
+            }
+            b = lnode_eval(e, n, args);
+            if (b && b->type == LVAL_NUM) {
+                *x = b->num;
+                lval_del(b);
+                return 1;
+            }
+            *v = b;
+            return 0;
+    }
+
+    // borrowed from the environment or the arguments
+    if (b->type == LVAL_NUM) {
+        *x = b->num;
+        return 1;
+    }
+    *v = lval_retain(b);
+    return 0;
+}
+
+// Evaluate operator node n, quickened to builtin f, returning 1 with
+// the result in *r, or 0 with an error or other value in *v
+int lnode_eval_op(lenv *e, lnode *n, lval *f, lval **args, long *r,
+        lval **v) {
+    lnode *c = n + n->child;
+    long x, y;
+    lval *bx = NULL;
+    lval *by = NULL;
+
+    int nx = lnode_eval_num(e, &c[1], args, &x, &bx);
+    if (!nx && (!bx || bx->type == LVAL_ERR)) {
+        *v = bx;
+        return 0;
+    }
+    int ny = lnode_eval_num(e, &c[2], args, &y, &by);
+    if (!ny && (!by || by->type == LVAL_ERR)) {
+        if (bx) lval_del(bx);
+        *v = by;
+        return 0;
+    }
+
+    if (nx && ny && lop_apply(f->desc->op, x, y, r)) {
+        lquick_op.hits++;
+        return 1;
+    }
+
+    // the builtin reports the error
+    lquick_op.fallbacks++;
+    if (nx) bx = lval_num(x);
+    if (ny) by = lval_num(y);
+    *v = lval_call_builtin(e, f, lval_add(lval_add(lval_sexpr(), bx), by));
+    return 0;
+}
+
+// Evaluate quickened n, NULL if its head no longer names the builtin,
+// leaving n to the general path
+lval *lnode_eval_quick(lenv *e, lnode *n, lval **args) {
+    lval *f = lnode_guard(e, n);
+    if (!f) return NULL;
+
+    if (lnode_is_op(n)) {
+        long r;
+        lval *v;
+        return lnode_eval_op(e, n, f, args, &r, &v) ? lop_box(r) : v;
+    }
+    if (n->flags & LNODE_FUSED && !args) return lnode_eval_fused(e, n, f);
+
+    // with the argument count checked when quickened, only their types
+    // are left to check, here rather than in ldesc_check
+    lnode *c = n + n->child;
+    int checked = n->flags & LNODE_CHECKED;
+    lval scratch;
+    lval *a = n->flags & LNODE_SCRATCH ? lval_scratch(&scratch) : lval_sexpr();
+    for (int i = 1; i < n->count; i++) {
+        lval *y = lnode_eval(e, &c[i], args);
+        if (!y || y->type == LVAL_ERR) {
+            lval_del(a);
+            return y;
+        }
+        int t = ldesc_type(f->desc, i - 1);
+        if (t != LTYPE_ANY && y->type != t) checked = 0;
+        a = lval_add(a, y);
+    }
+    if (args && !(f->desc->flags & LDESC_PURE)) {
+        lval_del(a);
+        return NULL;
+    }
+    // a mismatch is reported by lval_call_builtin
+    if (checked) return f->builtin(e, a);
+    return lval_call_builtin(e, f, a);
+}
+
+// Evaluate the list at n as an S-expression, like lval_eval_body
+lval *lnode_eval_list(lenv *e, lnode *n, lval **args) {
+    if (n->op) {
+        // an inlined lambda may have been freed since, see lnode_inline
+        lval *x = n->epoch > 0 ? lnode_eval_inline(e, n)
+            : lnode_eval_quick(e, n, args);
+        if (x || (args && n->op)) return x;
+    }
+
+    lnode *c = n + n->child;
+    lval *x = lval_sexpr();
+    for (int i = 0; i < n->count; i++) {
+        lval *y = lnode_eval(e, &c[i], args);
+        if (!y || y->type == LVAL_ERR) {
+            lval_del(x);
+            return y;
+        }
+        x = lval_add(x, y);
+    }
+
+    if (!x->count) return lval_apply(e, x);
+    lval *f = x->cell[0];
+    if (!n->op) lnode_quicken(e, n, f, args);
+
+    // inlined bodies only call pure builtins
+    if (args && x->count > 1 && f->type == LVAL_FUN && !lval_is_pure(f)) {
+        lval_del(x);
+        return NULL;
+    }
+    return lval_apply(e, x);
+}
+
+// Evaluate the value at n, like lval_eval_ref
+lval *lnode_eval(lenv *e, lnode *n, lval **args) {
+    switch (n->type) {
+        case LVAL_SYM: {
+            lval *x = lenv_get_cached(e, n->sym, &n->depth, &n->slot);
+            if (!x) return lval_err("Unbound symbol '%s'", n->sym);
+            return lval_retain(x);
+        }
+        case LVAL_SEXPR: return lnode_eval_list(e, n, args);
+        case LNODE_ARG: return lval_retain(args[n->slot]);
+    }
+    return lval_retain(n->val);
+}
+
+// Deforestation
+// A call of map, filter, foldl, sum, product or len whose list is the
+// result of map or filter, like (sum (map f (filter p l))), is run
+// in one pass: the inner calls are made lazy sequences, see lcursor, and
+// the outer builtin walks them without building the lists in between.
+// Every expression in the nest is evaluated once, as it would be
+// anyway, and every item is walked: take is left out, as it would stop
+// short of the items whose errors and side effects the unfused map
+// keeps. The builtins run in a different order when fused, so fusion
+// only goes ahead when each function they are given is free of side
+// effects, the inner heads still name map and filter, and the result
+// comes out the same; otherwise the inner calls are made from the same
+// values after all. A fused run that fails is not run again, as that
+// would evaluate the items of its list twice, so of several errors it
+// may report a different one than the unfused calls would have.
+
+// index of the list among the children of a call to f, 0 if f is not
+// a builtin that fusion runs over a sequence
+int lfuse_list_arg(lval *f) {
+    lbuiltin b = f->builtin;
+    if (b == builtin_sum || b == builtin_product || b == builtin_len) return 1;
+    if (b == builtin_map || b == builtin_filter) return 2;
+    if (b == builtin_foldl) return 3;
+    return 0;
+}
+
+// LSEQ_MAP or LSEQ_FILTER if n calls map or filter on a function and a
+// list, otherwise -1
+int lfuse_stage(lenv *e, lnode *n) {
+    lnode *c = n + n->child;
+    if (n->type != LVAL_SEXPR || n->count != 3 || c[0].type != LVAL_SYM) {
+        return -1;
+    }
+    lval *f = lenv_get_cached(e, c[0].sym, &c[0].depth, &c[0].slot);
+    if (!f || f->type != LVAL_FUN || !lval_is_immortal(f)) return -1;
+    if (f->builtin == builtin_map) return LSEQ_MAP;
+    if (f->builtin == builtin_filter) return LSEQ_FILTER;
+    return -1;
+}
+
+// Mark n, quickened to builtin f, if it is fully applied to the result
+// of map or filter
+void lnode_fuse(lenv *e, lnode *n, lval *f) {
+    int i = lfuse_list_arg(f);
+    if (!i || n->count - 1 != f->desc->arity) return;
+    if (lfuse_stage(e, n + n->child + i) < 0) return;
+    n->flags |= LNODE_FUSED;
+    lquick_fuse.rewritten++;
+}
+
+// 1 if list n in the body of a lambda with formals calls nothing but
+// pure builtins, and neither do the S-expressions in it
+int lfuse_pure_code(lenv *e, lnode *n, lval *formals) {
+    lnode *c = n + n->child;
+    if (n->type == LVAL_SEXPR && n->count > 1) {
+        if (c[0].type != LVAL_SYM) return 0;
+        for (int i = 0; i < formals->count; i++) {
+            if (strcmp(formals->cell[i]->sym, c[0].sym) == 0) return 0;
+        }
+        // looked up as the call would, leaving the node's cache to it
+        lval *f = lenv_get_borrowed(e, c[0].sym);
+        if (!f || f->type != LVAL_FUN || !lval_is_pure(f)) return 0;
+    }
+
+    for (int i = 0; i < n->count; i++) {
+        if (c[i].type == LVAL_SEXPR && !lfuse_pure_code(e, &c[i], formals)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// 1 if calling f, as a builtin would from e, has no side effects
+int lfuse_pure(lenv *e, lval *f) {
+    if (f->type != LVAL_FUN) return 0;
+    if (f->builtin) return lval_is_pure(f);
+    if (f->bound) f = f->fn;
+
+    lval *body = f->body;
+    if (!lval_is_interned(body)) return 0;
+    if (!body->code) lcode_build(body);
+    return body->code && lfuse_pure_code(e, body->code, f->formals);
+}
+
+// 1 if filter would keep items of Q-expression l that evaluate to
+// something else, which a lazy filter gives evaluated
+int lfuse_keeps_exprs(lval *l) {
+    for (int i = 0; i < l->count; i++) {
+        int t = l->cell[i]->type;
+        if (t == LVAL_SYM || t == LVAL_SEXPR) return 1;
+    }
+    return 0;
+}
+
+// Evaluate n, the list of a fused call, making each call of map or
+// filter in it a lazy sequence counted in *stages
+// *pure is cleared if running them lazily could tell the difference.
+lval *lnode_eval_stage(lenv *e, lnode *n, int *stages, int *pure) {
+    int kind = lfuse_stage(e, n);
+    if (kind < 0) return lnode_eval(e, n, NULL);
+
+    lnode *c = n + n->child;
+    lval *f = lnode_eval(e, &c[1], NULL);
+    if (!f || f->type == LVAL_ERR) return f;
+    lval *l = lnode_eval_stage(e, &c[2], stages, pure);
+    if (!l || l->type == LVAL_ERR) {
+        lval_del(f);
+        return l;
+    }
+
+    if (l->type != LVAL_QEXPR && l->type != LVAL_SEQ) *pure = 0;
+    if (!lfuse_pure(e, f)) *pure = 0;
+    if (kind == LSEQ_FILTER && l->type == LVAL_QEXPR && lfuse_keeps_exprs(l)) {
+        *pure = 0;
+    }
+    (*stages)++;
+    return lval_seq(kind, f, l);
+}
+
+// Run the outermost stages of s, made by lnode_eval_stage, with map
+// and filter themselves
+lval *lfuse_undo(lenv *e, lval *s, int stages) {
+    if (stages == 0) return s;
+
+    lval *l = lfuse_undo(e, lval_retain(s->src), stages - 1);
+    if (l->type == LVAL_ERR) {
+        lval_del(s);
+        return l;
+    }
+    lval *a = lval_add(lval_add(lval_sexpr(), lval_retain(s->gen)), l);
+    lbuiltin b = s->seq == LSEQ_MAP ? builtin_map : builtin_filter;
+    lval_del(s);
+    return b(e, a);
+}
+
+// Evaluate n, quickened to builtin f and marked by lnode_fuse
+lval *lnode_eval_fused(lenv *e, lnode *n, lval *f) {
+    lnode *c = n + n->child;
+    int li = lfuse_list_arg(f);
+    int stages = 0;
+    int pure = 1;
+
+    lval *a = lval_sexpr();
+    for (int i = 1; i < n->count; i++) {
+        lval *y = i == li ? lnode_eval_stage(e, &c[i], &stages, &pure)
+            : lnode_eval(e, &c[i], NULL);
+        if (!y || y->type == LVAL_ERR) {
+            lval_del(a);
+            return y;
+        }
+        a = lval_add(a, y);
+    }
+
+    // the function given to the outer builtin runs in a different order
+    if (li > 1 && !lfuse_pure(e, a->cell[0])) pure = 0;
+
+    if (pure && stages) {
+        lquick_fuse.hits++;
+        return lval_call_builtin(e, f, a);
+    }
+
+    lquick_fuse.fallbacks++;
+    lval *l = lfuse_undo(e, a->cell[li - 1], stages);
+    a->cell[li - 1] = l;
+    if (l->type == LVAL_ERR) {
+        lval_retain(l);
+        lval_del(a);
+        return l;
+    }
+    return lval_call_builtin(e, f, a);
+}
+
+// Inlining
+// A call to a small global lambda is replaced by a copy of its body in
+// an arena of its own, whose formals refer straight to the evaluated
+// arguments, so no environment is made and no lval_call is paid. Only
+// lambdas calling nothing but pure builtins, or their own arguments,
+// qualify. They cannot recurse, and never look at the environment a
+// call would have given them. Should one of them turn out to call
+// anything else, which can only be through an argument or a rebound
+// builtin, its evaluation stops before any side effect and the lambda
+// is called after all. Redefining an inlined lambda bumps
+// linline_epoch, which invalidates every inlined copy.
+
+#define LINLINE_BUDGET 16 // nodes in an inlined body
+#define LINLINE_ARGS 4
+#define LINLINE_NEVER -1
+
+static __thread int linline_epoch = 1;
+
+// 1 if list n, evaluated in global environment e, calls nothing but
+// pure builtins and arguments, and neither do the S-expressions in it
+int lcode_inlinable(lenv *e, lnode *n) {
+    lnode *c = n + n->child;
+    if (n->count > 1 && c[0].type != LNODE_ARG) {
+        if (c[0].type != LVAL_SYM) return 0;
+        lval *f = lenv_get_cached(e, c[0].sym, &c[0].depth, &c[0].slot);
+        if (!f || f->type != LVAL_FUN || !lval_is_pure(f)) return 0;
+    }
+
+    for (int i = 0; i < n->count; i++) {
+        if (c[i].type == LVAL_SEXPR && !lcode_inlinable(e, &c[i])) return 0;
+    }
+    return 1;
+}
+
+// Inline lambda f, the global value of the head of n, if it qualifies
+// Returns 1 if it did.
+int lnode_inline(lenv *e, lnode *n, lval *f) {
+    lnode *head = n + n->child;
+    if (n->epoch == LINLINE_NEVER || head->depth != LSLOT_GLOBAL) return 0;
+    if (f->bound || f->env->count) return 0;
+    lval *formals = f->formals;
+    if (formals->count != n->count - 1) return 0;
+    if (formals->count > LINLINE_ARGS) return 0;
+    if (lcode_size(f->body) > LINLINE_BUDGET) return 0;
+    for (int i = 0; i < formals->count; i++) {
+        if (strcmp(formals->cell[i]->sym, "&") == 0) return 0;
+    }
+
+    while (e->parent) e = e->parent;
+    lnode *body = lcode_new(f->body, formals);
+    if (!body) return 0;
+    if (!lcode_inlinable(e, body)) {
+        free(body);
+        n->epoch = LINLINE_NEVER;
+        return 0;
+    }
+
+    f->flags |= LALLOC_INLINED;
+    n->op = f;
+    n->body = body;
+    n->epoch = linline_epoch;
+    lquick_inline.rewritten++;
+    return 1;
+}
+
+// Undo the inlining at n, for good if never
+void lnode_uninline(lnode *n, int never) {
+    free(n->body);
+    n->op = NULL;
+    n->body = NULL;
+    n->epoch = never ? LINLINE_NEVER : 0;
+    lquick_inline.fallbacks++;
+}
+
+// Evaluate n through its inlined body, NULL if the inlined lambda was
+// redefined, leaving n to the general path
+lval *lnode_eval_inline(lenv *e, lnode *n) {
+    lnode *c = n + n->child;
+    lval *f = lenv_get_cached(e, c[0].sym, &c[0].depth, &c[0].slot);
+    if (f != n->op || n->epoch != linline_epoch) {
+        lnode_uninline(n, false);
+        return NULL;
+    }
+
+    // arguments may redefine f, so it is kept for the call
+    f = lval_retain(f);
+    int argc = n->count - 1;
+    lval *args[LINLINE_ARGS];
+    for (int i = 0; i < argc; i++) {
+        args[i] = lnode_eval(e, &c[i + 1], NULL);
+        if (args[i]->type == LVAL_ERR) {
+            lval *err = args[i];
+            while (i--) lval_del(args[i]);
+            lval_del(f);
+            return err;
+        }
+    }
+
+    lval *x = NULL;
+    if (n->op == f && n->epoch == linline_epoch) {
+        x = lnode_eval_list(e, n->body, args);
+        if (x) {
+            lquick_inline.hits++;
+        } else {
+            lnode_uninline(n, true);
+        }
+    }
+
+    // call f after all, with the arguments already evaluated
+    if (x) {
+        for (int i = 0; i < argc; i++) lval_del(args[i]);
+    } else {
+        lval *a = lval_sexpr();
+        for (int i = 0; i < argc; i++) a = lval_add(a, args[i]);
+        x = lval_call(e, f, a);
+    }
+    lval_del(f);
+    return x;
+}
+
 lval *lval_eval_sexpr(lenv *e, lval *v) {
 
-    // Evaluate children
+    // Evaluate children in place, stopping at the first error
+    lval_unshare(v);
     for (int i = 0; i < v->count; i++) {
         v->cell[i] = lval_eval(e, v->cell[i]);
+        if (v->cell[i]->type == LVAL_ERR) return lval_take(v, i);
     }
+
+    return lval_apply(e, v);
+}
+
+// Call an S-expression whose children are already evaluated
+lval *lval_apply(lenv *e, lval *v) {
     
     // Check children for errors
     for (int i = 0; i < v->count; i++) {
@@ -846,92 +3569,187 @@ lval *lval_eval(lenv *e, lval *v) {
         lval_del(v);
         return x;
     }
-    if (v->type == LVAL_SEXPR) return lval_eval_sexpr(e, v);
+    if (v->type == LVAL_SEXPR) {
+        // a shared expression is evaluated without being consumed
+        if (v->refs) {
+            lval *x = lval_eval_body(e, v);
+            lval_del(v);
+            return x;
+        }
+        return lval_eval_sexpr(e, v);
+    }
 
     return v;
 }
 
+// Evaluate the children of v as an S-expression without consuming v,
+// so a body can be run repeatedly without copying it first
+lval *lval_eval_body(lenv *e, lval *v) {
+    if (!v->code && lval_is_interned(v)) lcode_build(v);
+    if (v->code) return lnode_eval_list(e, v->code, NULL);
+
+    lval *x = lval_sexpr();
+    for (int i = 0; i < v->count; i++) {
+        lval *y = lval_eval_ref(e, v->cell[i]);
+        if (y->type == LVAL_ERR) {
+            lval_del(x);
+            return y;
+        }
+        x = lval_add(x, y);
+    }
+    return lval_apply(e, x);
+}
+
+// Evaluate v without taking ownership of it
+lval *lval_eval_ref(lenv *e, lval *v) {
+    if (v->type == LVAL_SYM) return lenv_get(e, v);
+    if (v->type == LVAL_SEXPR) return lval_eval_body(e, v);
+
+    return lval_retain(v);
+}
+
+// NULL if the arguments a suit descriptor d, otherwise the error,
+// having deleted a
+lval *ldesc_check(const ldesc *d, lval *a) {
+    if (d->arity >= 0) LASSERT_NUM(d->name, a, d->arity);
+
+    for (int i = 0; i < a->count; i++) {
+        int t = ldesc_type(d, i);
+        if (t != LTYPE_ANY) LASSERT_TYPE(d->name, a, i, t);
+    }
+    return NULL;
+}
+
+lval *lval_call_builtin(lenv *e, lval *f, lval *a) {
+    const ldesc *d = f->desc;
+
+    // arguments from an earlier partial application come first
+    if (f->bound) a = lval_join(lval_share_items(f->bound), a);
+    if (!d) return f->builtin(e, a);
+
+    if (d->flags & LDESC_CURRIED) {
+        if (a->count > d->arity) {
+            lval *err = lval_err("Function passed too many arguments. "
+                    "Got %i, Expected %i.", a->count, d->arity);
+            lval_del(a);
+            return err;
+        }
+
+        // too few arguments returns partial function
+        if (a->count < d->arity) {
+            lval *p = lval_fun(f->builtin);
+            p->desc = d;
+            p->bound = a;
+            return p;
+        }
+    }
+
+    lval *err = ldesc_check(d, a);
+    if (err) return err;
+    return f->builtin(e, a);
+}
+
+// S-expression of the items of l, shared rather than copied
+lval *lval_share_items(lval *l) {
+    lval *x = lval_sexpr();
+    lval_reserve(x, l->count);
+    for (int i = 0; i < l->count; i++) x = lval_add(x, lval_retain(l->cell[i]));
+    return x;
+}
+
+// 1 if binding given arguments to formals leaves some of them unbound,
+// before any '&' that would take the rest
+int lval_call_partial(lval *formals, int given) {
+    if (given >= formals->count) return 0;
+    for (int i = 0; i <= given; i++) {
+        if (strcmp(formals->cell[i]->sym, "&") == 0) return 0;
+    }
+    return 1;
+}
+
+// Call f with arguments a, leaving f untouched so that it can be
+// a value shared with the environment
 lval *lval_call(lenv *e, lval *f, lval *a) {
 
-    if (f->builtin) return f->builtin(e, a);
+    if (f->builtin) return lval_call_builtin(e, f, a);
+
+    // arguments from an earlier partial application come first, counts
+    // in errors are those of the partial application
+    int bound = 0;
+    if (f->bound) {
+        bound = f->bound->count;
+        a = lval_join(lval_share_items(f->bound), a);
+        f = f->fn;
+    }
+    lval *formals = f->formals;
+
+    // too few arguments returns a partial application
+    if (lval_call_partial(formals, a->count)) return lval_partial(f, a);
+
+    // arguments are bound in a fresh environment
+    lenv *env = lenv_copy(f->env);
 
     // Argument counts
-    int given = a->count;
-    int total = f->formals->count;
+    int given = a->count - bound;
+    int total = formals->count - bound;
+    int i = 0;
 
     // while args still remain
     while (a->count) {
-        if (f->formals->count == 0) {
+        if (i == formals->count) {
+            lenv_del(env);
             lval_del(a);
             return lval_err("Function passed too many arguments. "
             "Got %i, Expected %i.", given, total);
         }
 
-        // Pop first symbol from formals
-        lval *sym = lval_pop(f->formals, 0);
+        // next symbol from formals
+        lval *sym = formals->cell[i++];
 
         // Special case for '&'
         if (strcmp(sym->sym, "&") == 0) {
             // ensure & is followed by symbol
-            if (f->formals->count != 1) {
+            if (formals->count - i != 1) {
+                lenv_del(env);
                 lval_del(a);
                 return lval_err("Function format invalid. " 
                 "Symbol '&' not followed by single symbol.");
             }
             // next formal is bound to remaining arguments
-            lval *nsym = lval_pop(f->formals, 0);
-            lenv_put(f->env, nsym, builtin_list(e, a));
-            lval_del(sym);
-            lval_del(nsym);
+            lenv_put_move(env, formals->cell[i++], builtin_list(e, a));
+            a = NULL;
             break;
         }
 
         // next arg from list
-        lval *val = lval_pop(a, 0);
-        lenv_put(f->env, sym, val);
-
-        lval_del(sym);
-        lval_del(val);
+        lenv_put_move(env, sym, lval_pop(a, 0));
     }
     // arguments now bound
-    lval_del(a);
+    if (a) lval_del(a);
 
     // if '&' remains in formal list bind to empty list
-    if (f->formals->count > 0 && strcmp(f->formals->cell[0]->sym, "&") == 0) {
+    if (i < formals->count && strcmp(formals->cell[i]->sym, "&") == 0) {
 
-        if (f->formals->count != 2) {
+        if (formals->count - i != 2) {
+            lenv_del(env);
             return lval_err("Function format invalid. "
                             "Symbol '&' not followed by single symbol.");
         }
 
-        // pop and delete '&'
-        lval_del(lval_pop(f->formals, 0));
-
-        // pop next symbol and create empty list
-        lval *sym = lval_pop(f->formals, 0);
-        lval *val = lval_qexpr();
-
-        lenv_put(f->env, sym, val);
-        lval_del(sym);
-        lval_del(val);
+        lenv_put_move(env, formals->cell[i + 1], lval_qexpr());
+        i += 2;
     }
 
-    // evaluate if formals are all bound
-    if (f->formals->count == 0) {
-        // set parent
-        f->env->parent = e;
-
-        // eval the body
-        return builtin_eval(f->env, lval_add(lval_sexpr(), lval_copy(f->body)));
-    } else {
-        // otherwise return partial function
-        return lval_copy(f);
-    }
+    // formals are all bound, set parent and eval the body
+    env->parent = e;
+    lval *result = lval_eval_body(env, f->body);
+    lenv_del(env);
+    return result;
 }
 
 
 lenv *lenv_new() {
-    lenv *e = malloc(sizeof(lval));
+    lenv *e = lenv_alloc();
     e->parent = NULL;
     e->count = 0;
     e->syms = NULL;
@@ -941,115 +3759,243 @@ lenv *lenv_new() {
 
 void lenv_del(lenv *e) {
     for (int i = 0; i < e->count; i++) {
-        free(e->syms[i]); // syms are strings
+        lmem_free(e->syms[i]); // syms are strings
         lval_del(e->vals[i]);
 
     }
+    lmem_free(e->syms);
+    lmem_free(e->vals);
+    lenv_free(e);
 }
 
 lenv *lenv_copy(lenv *e) {
-    lenv *n = malloc(sizeof(lenv));
+    lenv *n = lenv_alloc();
     n->parent = e->parent;
     n->count = e->count;
-    n->syms = malloc(sizeof(char*) * n->count);
-    n->vals = malloc(sizeof(lval*) * n->count);
+    n->syms = n->count ? lmem_alloc(sizeof(char*) * n->count) : NULL;
+    n->vals = n->count ? lmem_alloc(sizeof(lval*) * n->count) : NULL;
     for (int i = 0; i < e->count; i++) {
-        n->syms[i] = malloc(strlen(e->syms[i]) + 1);
-        strcpy(n->syms[i], e->syms[i]);
-        n->vals[i] = lval_copy(e->vals[i]);
+        n->syms[i] = lstr_dup(e->syms[i]);
+        n->vals[i] = lval_copy_child(e->vals[i]);
     }
     return n;
 }
 
-// get lval from enviroment with given key (sym -> fun)
-lval *lenv_get(lenv *e, lval *k) {
-    
+// 1 if e itself, not its parents, binds sym
+int lenv_binds(lenv *e, char *sym) {
     for (int i = 0; i < e->count; i++) {
-        if (strcmp(e->syms[i], k->sym) == 0) {
-            return lval_copy(e->vals[i]);
+        if (strcmp(e->syms[i], sym) == 0) return 1;
+    }
+    return 0;
+}
+
+// Value bound to sym, still owned by the enviroment, or NULL if unbound
+// Only valid until the binding changes.
+lval *lenv_get_borrowed(lenv *e, char *sym) {
+    for (; e; e = e->parent) {
+        for (int i = 0; i < e->count; i++) {
+            if (strcmp(e->syms[i], sym) == 0) return e->vals[i];
         }
     }
+    return NULL;
+}
+
+// lenv_get_borrowed for sym, checking the slot it was last found in,
+// *depth and *slot, before searching that environment
+// The environments before it are still searched, so that a binding
+// shadowing the remembered one is found.
+lval *lenv_get_cached(lenv *e, char *sym, int *depth, int *slot) {
+    for (int d = 0; e; e = e->parent, d++) {
+        int here = e->parent ? d == *depth : *depth == LSLOT_GLOBAL;
+        if (here && *slot < e->count && strcmp(e->syms[*slot], sym) == 0) {
+            lquick_sym.hits++;
+            return e->vals[*slot];
+        }
 
-    // if no symbol check in parent environment
-    if (e->parent) {
-        return lenv_get(e->parent, k);
-    } else {
-    return lval_err("Unbound symbol '%s'", k->sym);
+        for (int i = 0; i < e->count; i++) {
+            if (strcmp(e->syms[i], sym) != 0) continue;
+
+            if (*depth == LSLOT_NONE) {
+                lquick_sym.rewritten++;
+            } else {
+                lquick_sym.fallbacks++;
+            }
+            *depth = e->parent ? d : LSLOT_GLOBAL;
+            *slot = i;
+            return e->vals[i];
+        }
     }
+    return NULL;
+}
 
+// lenv_get_cached with the slot kept in symbol k
+lval *lenv_get_slot(lenv *e, lval *k) {
+    return lenv_get_cached(e, k->sym, &k->depth, &k->slot);
 }
 
-void lenv_put(lenv *e, lval *k, lval *v) {
-    // check if already exists
-    // and replace with v
-    for (int i = 0; i < e->count; i++) {
-        if(strcmp(e->syms[i], k->sym) == 0) {
-            lval_del(e->vals[i]);
-            e->vals[i] = lval_copy(v);
-            return;
+// get lval from enviroment with given key (sym -> fun)
+// The value is shared with the enviroment, see lval_retain.
+lval *lenv_get(lenv *e, lval *k) {
+    lval *x = lenv_get_slot(e, k);
+    if (!x) return lval_err("Unbound symbol '%s'", k->sym);
+    return lval_retain(x);
+}
+
+// Bind k to v, taking ownership of v rather than copying it
+void lenv_put_move(lenv *e, lval *k, lval *v) {
+    // values kept by a heap environment are copied out of the region
+    int active = region.active;
+    if (!(e->flags & LALLOC_REGION)) {
+        region.active = 0;
+        if (lval_is_region(v)) {
+            lval *x = lval_copy(v);
+            lval_del(v);
+            v = x;
         }
     }
 
-    // allocate for new entry
-    e->count++;
-    e->vals = realloc(e->vals, sizeof(lval *) * e->count);
-    e->syms = realloc(e->syms, sizeof(char *) * e->count);
+    // check if already exists
+    // and replace with v
+    int i = 0;
+    while (i < e->count && strcmp(e->syms[i], k->sym) != 0) i++;
+
+    if (i < e->count) {
+        if (e->vals[i]->flags & LALLOC_INLINED) linline_epoch++;
+        lval_del(e->vals[i]);
+        e->vals[i] = v;
+    } else {
+        // allocate for new entry
+        e->count++;
+        e->vals = lmem_realloc(e->vals, sizeof(lval *) * e->count);
+        e->syms = lmem_realloc(e->syms, sizeof(char *) * e->count);
 
+        e->vals[e->count - 1] = v;
+        e->syms[e->count - 1] = lstr_dup(k->sym);
+    }
 
-    e->vals[e->count - 1] = lval_copy(v);
-    e->syms[e->count - 1] = malloc(strlen(k->sym) + 1);
-    strcpy(e->syms[e->count - 1], k->sym);
+    region.active = active;
 }
 
-// global variable definition
-void lenv_def(lenv *e, lval *k, lval *v) {
-    while (e->parent) e = e->parent;
+// Bind k to a copy of v
+void lenv_put(lenv *e, lval *k, lval *v) {
+    int active = region.active;
+    if (!(e->flags & LALLOC_REGION)) region.active = 0;
+    lval *x = lval_copy(v);
+    region.active = active;
 
-    lenv_put(e, k, v);
+    lenv_put_move(e, k, x);
 }
 
-void lenv_add_builtin(lenv *e, char *name, lbuiltin func) {
+void lenv_add_value(lenv *e, char *name, lval *v) {
     lval *k = lval_sym(name);
-    lval *v = lval_fun(func);
     lenv_put(e, k, v);
 
     lval_del(k);
     lval_del(v);
 }
 
-void lenv_add_builtins(lenv *e) {
+// Builtin descriptors
+// Builtins with LTYPE_ANY arguments check those themselves, the list
+// library to report the errors of its old core.jlsp definitions.
+#define Q LVAL_QEXPR
+#define N LVAL_NUM
+#define S LVAL_STR
+#define ANY LTYPE_ANY
+#define PURE LDESC_PURE
+#define CURRIED LDESC_CURRIED
+#define KEEPS LDESC_KEEPS_ARGS
+
+static const ldesc lbuiltins[] = {
     // List Functions
-    lenv_add_builtin(e, "list", builtin_list);
-    lenv_add_builtin(e, "head", builtin_head);
-    lenv_add_builtin(e, "tail", builtin_tail);
-    lenv_add_builtin(e, "eval", builtin_eval);
-    lenv_add_builtin(e, "join", builtin_join);
+    { "list", builtin_list, -1, PURE | KEEPS, { ANY } },
+    { "head", builtin_head, 1, PURE, { Q } },
+    { "tail", builtin_tail, 1, PURE, { Q } },
+    { "eval", builtin_eval, 1, 0, { Q } },
+    { "join", builtin_join, -1, PURE, { ANY } },
+
+    // List Library
+    { "len", builtin_len, 1, CURRIED, { ANY } },
+    { "nth", builtin_nth, 2, CURRIED, { ANY, ANY } },
+    { "last", builtin_last, 1, CURRIED, { ANY } },
+    { "map", builtin_map, 2, CURRIED, { ANY, ANY } },
+    { "filter", builtin_filter, 2, CURRIED, { ANY, ANY } },
+    { "take", builtin_take, 2, CURRIED, { ANY, ANY } },
+    { "drop", builtin_drop, 2, CURRIED, { ANY, ANY } },
+    { "elem", builtin_elem, 2, CURRIED, { ANY, ANY } },
+    { "foldl", builtin_foldl, 3, CURRIED, { ANY, ANY, ANY } },
+    #define X(name, sym, ...) { #name, builtin_##name, 1, CURRIED, { ANY } },
+    LFOLD_OPS(X)
+    #undef X
+    { "unpack", builtin_unpack, 2, CURRIED, { ANY, ANY } },
+    { "pack", builtin_pack, -1, KEEPS, { ANY } },
+
+    // Sequence Functions
+    { "range", builtin_range, 2, PURE, { N, N } },
+    { "iterate", builtin_iterate, 2, PURE | CURRIED, { LVAL_FUN, ANY } },
+    { "lazy-map", builtin_lazy_map, 2, PURE | CURRIED, { LVAL_FUN, ANY } },
+    { "lazy-filter", builtin_lazy_filter, 2, PURE | CURRIED,
+        { LVAL_FUN, ANY } },
+
+    // Transducers
+    { "mapping", builtin_mapping, 4, CURRIED, { ANY, ANY, ANY } },
+    { "filtering", builtin_filtering, 4, CURRIED, { ANY, ANY, ANY } },
+    { "taking", builtin_taking, 2, PURE | CURRIED, { N, ANY } },
+    { "transduce", builtin_transduce, 4, CURRIED, { ANY, ANY, ANY } },
 
     // Math functions
-    lenv_add_builtin(e, "+", builtin_add);
-    lenv_add_builtin(e, "-", builtin_sub);
-    lenv_add_builtin(e, "*", builtin_mul);
-    lenv_add_builtin(e, "/", builtin_div);
-    lenv_add_builtin(e, "^", builtin_pow);
+    #define X(name, sym, ...) \
+        { sym, builtin_##name, -1, PURE, { N }, LOP_##name },
+    LARITH_OPS(X)
+    #undef X
 
     // Variable Functions
-    lenv_add_builtin(e, "\\", builtin_lambda);
-    lenv_add_builtin(e, "def", builtin_def);
-    lenv_add_builtin(e, "=", builtin_put);
+    { "\\", builtin_lambda, 2, PURE, { Q, Q } },
+    { "def", builtin_def, -1, 0, { ANY } },
+    { "=", builtin_put, -1, 0, { ANY } },
+
+    // Loop Functions
+    { "while", builtin_while, 2, 0, { Q, Q } },
+    { "dotimes", builtin_dotimes, 3, 0, { Q, N, Q } },
 
     // String functions
-    lenv_add_builtin(e, "load", builtin_load);
-    lenv_add_builtin(e, "error", builtin_error);
-    lenv_add_builtin(e, "print", builtin_print);
+    { "load", builtin_load, 1, 0, { S } },
+    { "error", builtin_error, 1, PURE, { S } },
+    { "try", builtin_try, 2, 0, { Q, LVAL_FUN } },
+    { "print", builtin_print, -1, 0, { ANY } },
+
+    // Memory Functions
+    { "alloc-stats", builtin_alloc_stats, 1, 0, { S } },
+    { "quicken-stats", builtin_quicken_stats, 1, 0, { S } },
 
     /* Comparison Functions */
-    lenv_add_builtin(e, "if", builtin_if);
-    lenv_add_builtin(e, "==", builtin_eq);
-    lenv_add_builtin(e, "!=", builtin_ne);
-    lenv_add_builtin(e, ">",  builtin_gt);
-    lenv_add_builtin(e, "<",  builtin_lt);
-    lenv_add_builtin(e, "<=", builtin_le);
-    lenv_add_builtin(e, ">=", builtin_ge);
+    { "if", builtin_if, 3, 0, { N, Q, Q } },
+    #define X(name, sym, ...) { sym, builtin_##name, 2, PURE, { ANY, ANY } },
+    LCMP_OPS(X)
+    #undef X
+    #define X(name, sym, ...) \
+        { sym, builtin_##name, 2, PURE, { N, N }, LOP_##name },
+    LORD_OPS(X)
+    #undef X
+};
+
+#undef Q
+#undef N
+#undef S
+#undef ANY
+#undef PURE
+#undef CURRIED
+#undef KEEPS
+
+void lenv_add_builtins(lenv *e) {
+    // Atoms
+    lenv_add_value(e, "nil", lval_nil());
+    lenv_add_value(e, "true", lval_bool(true));
+    lenv_add_value(e, "false", lval_bool(false));
+
+    int n = sizeof(lbuiltins) / sizeof(lbuiltins[0]);
+    for (int i = 0; i < n; i++) {
+        lenv_add_value(e, lbuiltins[i].name, lval_builtin(&lbuiltins[i]));
+    }
 }
 
 int main(int argc, char *argv[]) {
@@ -1115,9 +4061,11 @@ int main(int argc, char *argv[]) {
 
             mpc_result_t r;
             if (mpc_parse("<stdin>", input, lispy, &r)) {
+                int opened = lregion_begin();
                 lval *x = lval_eval(e, lval_read(r.output));
                 lval_println(x);
                 lval_del(x);
+                if (opened) lregion_end();
 
                 mpc_ast_delete(r.output);
             } else {